@@ -0,0 +1,115 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Next hop adjacencies with precomputed Ethernet headers.  See sr_adj.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_adj.h"
+#include "sr_if.h"
+
+int sr_adjtab_add(struct sr_adjtab* tab, uint32_t gw, const char* iface)
+{
+    struct sr_adj* adj;
+    unsigned int i;
+
+    /* -- REQUIRES -- */
+    assert(tab);
+    assert(iface);
+
+    for(i = 0; i < tab->num; i++)
+    {
+        if(tab->adjs[i].gw == gw &&
+           !strncmp(tab->adjs[i].iface, iface, sr_IFACE_NAMELEN))
+        { return i; }
+    }
+
+    if(tab->num == tab->cap)
+    {
+        unsigned int cap = tab->cap ? tab->cap * 2 : 8;
+        struct sr_adj* adjs = (struct sr_adj*)realloc(tab->adjs,
+                                              cap * sizeof(struct sr_adj));
+        if(!adjs)
+        { return -1; }
+        tab->adjs = adjs;
+        tab->cap = cap;
+    }
+
+    adj = &tab->adjs[tab->num];
+    memset(adj, 0, sizeof(struct sr_adj));
+    adj->gw = gw;
+    strncpy(adj->iface, iface, sr_IFACE_NAMELEN);
+    adj->ifindex = -1;
+    ((sr_ethernet_hdr_t*)adj->l2hdr)->ether_type = htons(ethertype_ip);
+
+    return tab->num++;
+} /* -- sr_adjtab_add -- */
+
+void sr_adjtab_destroy(struct sr_adjtab* tab)
+{
+    free(tab->adjs);
+    tab->adjs = 0;
+    tab->num = tab->cap = 0;
+} /* -- sr_adjtab_destroy -- */
+
+void sr_adjtab_update(struct sr_adjtab* tab, uint32_t gw,
+                      const unsigned char* mac, unsigned int gen,
+                      int handle)
+{
+    unsigned int i;
+
+    for(i = 0; i < tab->num; i++)
+    {
+        if(tab->adjs[i].gw == gw)
+        { sr_adj_set_mac(&tab->adjs[i], mac, gen, handle); }
+    }
+} /* -- sr_adjtab_update -- */
+
+void sr_adj_bind(struct sr_adj* adj, const struct sr_if* iface)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)adj->l2hdr;
+
+    memcpy(eth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    adj->ifindex = iface->index;
+} /* -- sr_adj_bind -- */
+
+void sr_adj_set_mac(struct sr_adj* adj, const unsigned char* mac,
+                    unsigned int gen, int handle)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)adj->l2hdr;
+    unsigned int seq;
+
+    /* -- an even count taken from even to odd makes us the writer -- */
+    do
+    { seq = adj->seq; }
+    while((seq & 1) || !__sync_bool_compare_and_swap(&(adj->seq), seq, seq + 1));
+
+    memcpy(eth->ether_dhost, mac, ETHER_ADDR_LEN);
+    adj->arp_gen = gen;
+    adj->arp_handle = handle;
+
+    __atomic_store_n(&(adj->seq), seq + 2, __ATOMIC_RELEASE);
+} /* -- sr_adj_set_mac -- */
+
+void sr_adj_load(const struct sr_adj* adj, uint8_t* l2hdr,
+                 unsigned int* gen, int* handle)
+{
+    unsigned int seq;
+
+    do
+    {
+        seq = __atomic_load_n(&(adj->seq), __ATOMIC_ACQUIRE);
+        memcpy(l2hdr, adj->l2hdr, sizeof(adj->l2hdr));
+        *gen = adj->arp_gen;
+        *handle = adj->arp_handle;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    }
+    while((seq & 1) || seq != adj->seq);
+} /* -- sr_adj_load -- */
@@ -0,0 +1,79 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_adj.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Next hop adjacency table.  One adjacency exists per distinct
+ * (gateway, outgoing interface) pair in the routing table and holds the
+ * Ethernet header every packet sent to that next hop carries, so
+ * forwarding is a route lookup plus one header copy.
+ *
+ * The source MAC and interface index are filled in once the interface
+ * is known (sr_adj_bind), the destination MAC whenever ARP resolves the
+ * gateway (sr_adjtab_update).  The destination half is trusted only
+ * while arp_gen matches the ARP cache generation, which the cache bumps
+ * when entries expire.  Until then arp_handle names the ARP entry the
+ * MAC came from, so forwarding can mark it in use.
+ *
+ * Forwarding workers read the destination half while others rewrite
+ * it, so it is guarded by a sequence count: writers make it odd while
+ * they change the MAC, readers copy with sr_adj_load() and retry if it
+ * was odd or moved.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ADJ_H
+#define SR_ADJ_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_protocol.h"
+
+struct sr_if;
+
+struct sr_adj
+{
+    uint32_t gw;                     /* next hop, network byte order */
+    char iface[sr_IFACE_NAMELEN];    /* outgoing interface */
+    int ifindex;                     /* -1 until bound */
+    unsigned int arp_gen;            /* dst MAC valid while current */
+    int arp_handle;                  /* from sr_arpcache_lookup, 0 if unknown */
+    uint8_t l2hdr[sizeof(sr_ethernet_hdr_t)]; /* dst MAC, src MAC, type */
+    volatile unsigned int seq;       /* odd while the dst MAC changes */
+};
+
+struct sr_adjtab
+{
+    struct sr_adj* adjs;
+    unsigned int num;
+    unsigned int cap;
+};
+
+/* Returns the index of the adjacency for (gw, iface), adding it if
+   needed, or -1 if out of memory.  Indices stay valid while the table
+   grows, pointers do not. */
+int  sr_adjtab_add(struct sr_adjtab* tab, uint32_t gw, const char* iface);
+void sr_adjtab_destroy(struct sr_adjtab* tab);
+
+/* Writes mac into every adjacency whose gateway is gw and marks it
+   current for ARP generation gen. */
+void sr_adjtab_update(struct sr_adjtab* tab, uint32_t gw,
+                      const unsigned char* mac, unsigned int gen,
+                      int handle);
+
+void sr_adj_bind(struct sr_adj* adj, const struct sr_if* iface);
+void sr_adj_set_mac(struct sr_adj* adj, const unsigned char* mac,
+                    unsigned int gen, int handle);
+
+/* Copies the header, generation and handle as one consistent set. */
+void sr_adj_load(const struct sr_adj* adj, uint8_t* l2hdr,
+                 unsigned int* gen, int* handle);
+
+#endif /* -- SR_ADJ_H -- */
@@ -0,0 +1,491 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * TPACKET_V3 rings on real interfaces.  See sr_afpacket.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sr_afpacket.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+
+#ifdef _LINUX_
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#define SR_AFP_RX_SIZE  ((size_t)SR_AFP_BLOCK_SIZE * SR_AFP_BLOCK_NR)
+#define SR_AFP_TX_PER_BLOCK (SR_AFP_BLOCK_SIZE / SR_AFP_FRAME_SIZE)
+#define SR_AFP_TX_BLOCKS ((SR_AFP_TX_FRAMES + SR_AFP_TX_PER_BLOCK - 1) / \
+                          SR_AFP_TX_PER_BLOCK)
+#define SR_AFP_TX_SIZE  ((size_t)SR_AFP_BLOCK_SIZE * SR_AFP_TX_BLOCKS)
+
+/* where the kernel expects a transmitted frame within its slot */
+#define SR_AFP_TX_DATA  TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+static struct tpacket3_hdr* sr_afp_tx_slot(struct sr_afp_port* p,
+                                           unsigned int slot)
+{
+    return (struct tpacket3_hdr*)(p->map + SR_AFP_RX_SIZE +
+            (size_t)(slot / SR_AFP_TX_PER_BLOCK) * SR_AFP_BLOCK_SIZE +
+            (slot % SR_AFP_TX_PER_BLOCK) * SR_AFP_FRAME_SIZE);
+} /* -- sr_afp_tx_slot -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_open_port(..)
+ * Scope:  Local
+ *
+ * Sets up the rings on interface name and adds it to the router, with
+ * the kernel's MAC and the given or the kernel's IPv4 address.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_open_port(struct sr_instance* sr, struct sr_afp_port* p,
+                            const char* name, const char* addr)
+{
+    struct ifreq ifr;
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    struct in_addr ip;
+    unsigned char mac[ETHER_ADDR_LEN];
+    int ifindex, one = 1, version = TPACKET_V3;
+
+    p->fd = -1;
+    p->map = MAP_FAILED;
+
+    if((p->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
+    {
+        perror("socket(..):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if(ioctl(p->fd, SIOCGIFINDEX, &ifr) < 0)
+    {
+        fprintf(stderr, "Error: no interface %s\n", name);
+        return -1;
+    }
+    ifindex = ifr.ifr_ifindex;
+    if(ioctl(p->fd, SIOCGIFHWADDR, &ifr) < 0)
+    {
+        perror("ioctl(SIOCGIFHWADDR):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+    memcpy(mac, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+
+    if(addr)
+    {
+        if(inet_aton(addr, &ip) == 0)
+        {
+            fprintf(stderr, "Error: bad address %s for %s\n", addr, name);
+            return -1;
+        }
+    }
+    else
+    {
+        if(ioctl(p->fd, SIOCGIFADDR, &ifr) < 0)
+        {
+            fprintf(stderr, "Error: %s has no IPv4 address, give one as %s=ip\n",
+                    name, name);
+            return -1;
+        }
+        ip = ((struct sockaddr_in*)&(ifr.ifr_addr))->sin_addr;
+    }
+
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_VERSION,
+                  &version, sizeof(version)) < 0)
+    {
+        perror("setsockopt(PACKET_VERSION):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    req.tp_block_nr = SR_AFP_BLOCK_NR;
+    req.tp_frame_size = SR_AFP_FRAME_SIZE;
+    req.tp_frame_nr = SR_AFP_RX_SIZE / SR_AFP_FRAME_SIZE;
+    req.tp_retire_blk_tov = SR_AFP_BLOCK_TOV;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+    {
+        perror("setsockopt(PACKET_RX_RING):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+
+    /* -- the transmit ring is slotted, block timeouts do not apply -- */
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    req.tp_block_nr = SR_AFP_TX_BLOCKS;
+    req.tp_frame_size = SR_AFP_FRAME_SIZE;
+    req.tp_frame_nr = SR_AFP_TX_BLOCKS * SR_AFP_TX_PER_BLOCK;
+    if(setsockopt(p->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+    {
+        perror("setsockopt(PACKET_TX_RING):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+
+    /* -- nice to have: skip malformed slots, skip the qdisc, and do not
+          see our own frames again -- */
+    setsockopt(p->fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one));
+    setsockopt(p->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#ifdef PACKET_IGNORE_OUTGOING
+    setsockopt(p->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+    p->map_size = SR_AFP_RX_SIZE + SR_AFP_TX_SIZE;
+    p->map = (uint8_t*)mmap(0, p->map_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, p->fd, 0);
+    if(p->map == MAP_FAILED)
+    {
+        perror("mmap(..):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if(bind(p->fd, (struct sockaddr*)&sll, sizeof(sll)) < 0)
+    {
+        perror("bind(..):sr_afpacket.c::sr_afp_open_port");
+        return -1;
+    }
+
+    pthread_mutex_init(&(p->tx_lock), 0);
+
+    if(sr_add_interface(sr, name) != 0)
+    { return -1; }
+    sr_set_ether_addr(sr, mac);
+    sr_set_ether_ip(sr, ip.s_addr);
+    return 0;
+} /* -- sr_afp_open_port -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afpacket_open(..)
+ * Scope:  Global
+ *
+ * Counterpart of sr_connect_to_server() and sr_handle_hwinfo() for
+ * real interfaces.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_afpacket_open(struct sr_instance* sr, const char* spec)
+{
+    struct sr_afpacket* afp;
+    char list[256];
+    char* name;
+    char* save = 0;
+
+    if((afp = (struct sr_afpacket*)calloc(1, sizeof(struct sr_afpacket))) == 0)
+    { return -1; }
+    sr->afp = afp;
+
+    strncpy(list, spec, sizeof(list) - 1);
+    list[sizeof(list) - 1] = 0;
+
+    for(name = strtok_r(list, ",", &save); name;
+        name = strtok_r(0, ",", &save))
+    {
+        char* addr = strchr(name, '=');
+
+        if(addr)
+        { *addr++ = 0; }
+        if(sr->iftab.num == SR_IF_MAX)
+        {
+            fprintf(stderr, "Error: more than %d interfaces\n", SR_IF_MAX);
+            return -1;
+        }
+        /* -- ports are indexed like the interfaces they become -- */
+        if(sr_afp_open_port(sr, &(afp->port[sr->iftab.num]), name, addr) != 0)
+        {
+            afp->num = sr->iftab.num + 1;
+            return -1;
+        }
+        afp->num = sr->iftab.num;
+    }
+
+    if(afp->num == 0)
+    {
+        fprintf(stderr, "Error: no interfaces in \"%s\"\n", spec);
+        return -1;
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+    sr_if_build_templates(sr);
+
+    /* -- routes were loaded before their interfaces existed -- */
+    sr_rt_bind_interfaces(sr);
+    return 0;
+} /* -- sr_afpacket_open -- */
+
+void sr_afpacket_close(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = sr->afp;
+    unsigned int i;
+
+    if(!afp)
+    { return; }
+
+    /* the ARP thread flushes the rings */
+    sr_arpcache_stop(&(sr->cache));
+
+    for(i = 0; i < afp->num; i++)
+    {
+        struct sr_afp_port* p = &(afp->port[i]);
+
+        if(p->map != MAP_FAILED)
+        { munmap(p->map, p->map_size); }
+        if(p->fd >= 0)
+        { close(p->fd); }
+    }
+    sr->afp = 0;
+    free(afp);
+} /* -- sr_afpacket_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_rx(..)
+ * Scope:  Local
+ *
+ * Handles every block the kernel has filled on port index.  The frames
+ * are handled in place, so a block is only returned after its last
+ * burst.  Returns the number of blocks handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_afp_rx(struct sr_instance* sr, unsigned int index)
+{
+    struct sr_afp_port* p = &(sr->afp->port[index]);
+    struct sr_if* iface = sr_get_interface_idx(sr, index);
+    uint8_t* pkts[SR_VNS_RX_BURST];
+    unsigned int lens[SR_VNS_RX_BURST];
+    struct sr_if* ifaces[SR_VNS_RX_BURST];
+    unsigned int n = 0, blocks = 0;
+
+    for(;;)
+    {
+        struct tpacket_block_desc* bd = (struct tpacket_block_desc*)
+            (p->map + (size_t)p->rx_block * SR_AFP_BLOCK_SIZE);
+        struct tpacket3_hdr* h;
+        unsigned int k, num;
+
+        if(!(__atomic_load_n(&(bd->hdr.bh1.block_status), __ATOMIC_ACQUIRE) &
+             TP_STATUS_USER))
+        { break; }
+
+        num = bd->hdr.bh1.num_pkts;
+        h = (struct tpacket3_hdr*)((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for(k = 0; k < num; k++)
+        {
+            struct sockaddr_ll* sll = (struct sockaddr_ll*)
+                ((uint8_t*)h + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+            if(sll->sll_pkttype != PACKET_OUTGOING)
+            {
+                sr_rx_frame(sr, (uint8_t*)h + h->tp_mac, h->tp_snaplen, iface,
+                            pkts, lens, ifaces, &n);
+                p->rx_frames++;
+                if(sr->afp->nstamp < SR_AFP_STAMPS)
+                {
+                    sr->afp->stamp[sr->afp->nstamp++] =
+                        (uint64_t)h->tp_sec * 1000000000ULL + h->tp_nsec;
+                }
+                if(n == SR_VNS_RX_BURST)
+                {
+                    sr_handlepacket_burst(sr, pkts, lens, ifaces, n);
+                    n = 0;
+                }
+            }
+            h = (struct tpacket3_hdr*)((uint8_t*)h + h->tp_next_offset);
+        }
+
+        sr_handlepacket_burst(sr, pkts, lens, ifaces, n);
+        n = 0;
+        __atomic_store_n(&(bd->hdr.bh1.block_status), TP_STATUS_KERNEL,
+                         __ATOMIC_RELEASE);
+        p->rx_block = (p->rx_block + 1) % SR_AFP_BLOCK_NR;
+        p->rx_blocks++;
+        blocks++;
+    }
+
+    return blocks;
+} /* -- sr_afp_rx -- */
+
+int sr_afpacket_read(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = sr->afp;
+    struct pollfd pfd[SR_IF_MAX];
+    unsigned int i, blocks = 0;
+    uint64_t now;
+
+    afp->nstamp = 0;
+    for(i = 0; i < afp->num; i++)
+    { blocks += sr_afp_rx(sr, i); }
+
+    if(blocks == 0 && sr->busy.idle_us)
+    {
+        sr_afpacket_flush(afp);
+        sr_busypoll_idle(&(sr->busy));
+        return 1;
+    }
+
+    if(blocks == 0)
+    {
+        for(i = 0; i < afp->num; i++)
+        {
+            pfd[i].fd = afp->port[i].fd;
+            pfd[i].events = POLLIN | POLLERR;
+            pfd[i].revents = 0;
+        }
+        if(poll(pfd, afp->num, -1) < 0)
+        {
+            if(errno == EINTR)
+            { return 1; }
+            perror("poll(..):sr_afpacket.c::sr_afpacket_read");
+            return -1;
+        }
+        sr->busy.wakeups++;
+        for(i = 0; i < afp->num; i++)
+        {
+            if(pfd[i].revents)
+            { sr_afp_rx(sr, i); }
+        }
+    }
+
+    /* -- everything the frames produced goes out together -- */
+    sr_afpacket_flush(afp);
+
+    sr_busypoll_work(&(sr->busy));
+    now = sr_busypoll_wall();
+    for(i = 0; !sr->workers && i < afp->nstamp; i++)
+    { sr_lat_add(&(sr->busy.lat), sr_busypoll_age(afp->stamp[i], now), 1); }
+    return 1;
+} /* -- sr_afpacket_read -- */
+
+/* hands the filled slots to the kernel; caller holds the tx lock */
+static void sr_afp_kick(struct sr_afp_port* p)
+{
+    p->tx_kicks++;
+    if(send(p->fd, 0, 0, MSG_DONTWAIT) < 0)
+    {
+        /* -- on a full device queue the slots stay requested for next time -- */
+        if(errno == EAGAIN || errno == ENOBUFS || errno == EINTR)
+        { return; }
+        perror("send(..):sr_afpacket.c::sr_afp_kick");
+    }
+    p->tx_pending = 0;
+} /* -- sr_afp_kick -- */
+
+int sr_afpacket_send(struct sr_afpacket* afp, const struct sr_if* iface,
+                     const uint8_t* frame, unsigned int len)
+{
+    struct sr_afp_port* p = &(afp->port[iface->index]);
+    struct tpacket3_hdr* h;
+    unsigned int status;
+
+    pthread_mutex_lock(&(p->tx_lock));
+
+    h = sr_afp_tx_slot(p, p->tx_slot);
+    status = __atomic_load_n(&(h->tp_status), __ATOMIC_ACQUIRE);
+    if(status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT &&
+       p->tx_pending > 0)
+    {
+        sr_afp_kick(p);
+        status = __atomic_load_n(&(h->tp_status), __ATOMIC_ACQUIRE);
+    }
+    if(len > SR_AFP_FRAME_SIZE - SR_AFP_TX_DATA ||
+       (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT))
+    {
+        p->tx_drops++;
+        pthread_mutex_unlock(&(p->tx_lock));
+        return -1;
+    }
+
+    memcpy((uint8_t*)h + SR_AFP_TX_DATA, frame, len);
+    h->tp_len = len;
+    h->tp_snaplen = len;
+    h->tp_next_offset = 0;
+    __atomic_store_n(&(h->tp_status), TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    p->tx_slot = (p->tx_slot + 1) % (SR_AFP_TX_BLOCKS * SR_AFP_TX_PER_BLOCK);
+    p->tx_frames++;
+    if(++(p->tx_pending) >= SR_AFP_TX_BATCH)
+    { sr_afp_kick(p); }
+
+    pthread_mutex_unlock(&(p->tx_lock));
+    return 0;
+} /* -- sr_afpacket_send -- */
+
+void sr_afpacket_flush(struct sr_afpacket* afp)
+{
+    unsigned int i;
+
+    for(i = 0; i < afp->num; i++)
+    {
+        struct sr_afp_port* p = &(afp->port[i]);
+
+        pthread_mutex_lock(&(p->tx_lock));
+        if(p->tx_pending > 0)
+        { sr_afp_kick(p); }
+        pthread_mutex_unlock(&(p->tx_lock));
+    }
+} /* -- sr_afpacket_flush -- */
+
+void sr_afpacket_dump_stats(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    fprintf(stderr, "AF_PACKET rings:\n");
+    for(i = 0; i < sr->afp->num; i++)
+    {
+        struct sr_afp_port* p = &(sr->afp->port[i]);
+        struct tpacket_stats_v3 st;
+        socklen_t st_len = sizeof(st);
+
+        memset(&st, 0, sizeof(st));
+        getsockopt(p->fd, SOL_PACKET, PACKET_STATISTICS, &st, &st_len);
+        fprintf(stderr, "  %s: rx %lu in %lu blocks, ring drops %u, "
+                "tx %lu in %lu kicks, dropped %lu\n",
+                sr->iftab.ifs[i]->name, p->rx_frames, p->rx_blocks,
+                st.tp_drops, p->tx_frames, p->tx_kicks, p->tx_drops);
+    }
+} /* -- sr_afpacket_dump_stats -- */
+
+#else /* -- !_LINUX_ -- */
+
+int sr_afpacket_open(struct sr_instance* sr, const char* spec)
+{
+    fprintf(stderr, "Error: AF_PACKET interfaces need Linux\n");
+    return -1;
+} /* -- sr_afpacket_open -- */
+
+void sr_afpacket_close(struct sr_instance* sr) { }
+
+int sr_afpacket_read(struct sr_instance* sr)
+{ return -1; }
+
+int sr_afpacket_send(struct sr_afpacket* afp, const struct sr_if* iface,
+                     const uint8_t* frame, unsigned int len)
+{ return -1; }
+
+void sr_afpacket_flush(struct sr_afpacket* afp) { }
+
+void sr_afpacket_dump_stats(struct sr_instance* sr) { }
+
+#endif /* -- _LINUX_ -- */
@@ -0,0 +1,88 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Backend that runs the router on real Linux interfaces instead of a VNS
+ * connection.  Each interface gets an AF_PACKET socket with a TPACKET_V3
+ * receive ring and a transmit ring, both mapped into the router.  Frames
+ * are handed to sr_handlepacket_burst() where the kernel put them, one
+ * block at a time, and the block goes back to the kernel once they have
+ * been handled.  Sent frames are copied into free transmit slots and go
+ * out together when the ring is kicked.
+ *
+ * The interfaces are given as "name[=ip],..."; without an address the
+ * one the kernel has on the interface is used.  The kernel should not
+ * route or answer for that address itself, so give the router its own
+ * address or run it in a namespace of its own.  Turn off checksum
+ * offload on the peers, the router forwards frames as they come.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_AFPACKET_H
+#define SR_AFPACKET_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+
+#define SR_AFP_BLOCK_SIZE   (1 << 18)   /* receive ring block */
+#define SR_AFP_BLOCK_NR     16
+#define SR_AFP_BLOCK_TOV    1           /* ms before a partial block is handed over */
+#define SR_AFP_FRAME_SIZE   2048        /* transmit slot */
+#define SR_AFP_TX_FRAMES    256         /* transmit slots per interface */
+#define SR_AFP_TX_BATCH     64          /* pending slots that force a kick */
+#define SR_AFP_STAMPS       1024        /* frames timed per read */
+
+struct sr_instance;
+
+struct sr_afp_port
+{
+    int fd;
+    uint8_t* map;               /* receive ring, then transmit ring */
+    size_t map_size;
+    unsigned int rx_block;      /* next block to look at */
+    unsigned int tx_slot;       /* next transmit slot to fill */
+    unsigned int tx_pending;    /* slots filled since the last kick */
+    unsigned long rx_frames;
+    unsigned long rx_blocks;
+    unsigned long tx_frames;
+    unsigned long tx_kicks;     /* send() calls */
+    unsigned long tx_drops;     /* no free slot, or frame too long */
+    pthread_mutex_t tx_lock;    /* reader, workers, writer and ARP cache thread send */
+};
+
+struct sr_afpacket
+{
+    struct sr_afp_port port[SR_IF_MAX];     /* by sr_if->index */
+    unsigned int num;
+    uint64_t stamp[SR_AFP_STAMPS];  /* wall clock kernel receive times */
+    unsigned int nstamp;
+};
+
+/* Opens the interfaces in spec and adds them to sr->if_list.  Returns 0,
+   or -1 if any of them could not be set up. */
+int  sr_afpacket_open(struct sr_instance* sr, const char* spec);
+void sr_afpacket_close(struct sr_instance* sr);
+
+/* Waits for frames, or polls for them when sr->busy says so, handles
+   them and kicks the transmit rings.  Returns 1 to keep going and -1 on
+   error. */
+int  sr_afpacket_read(struct sr_instance* sr);
+
+/* Queues len bytes of frame on iface.  Returns 0, or -1 if it was
+   dropped. */
+int  sr_afpacket_send(struct sr_afpacket* afp, const struct sr_if* iface,
+                      const uint8_t* frame, unsigned int len);
+
+/* Hands every filled transmit slot to the kernel. */
+void sr_afpacket_flush(struct sr_afpacket* afp);
+
+void sr_afpacket_dump_stats(struct sr_instance* sr);
+
+#endif /* -- SR_AFPACKET_H -- */
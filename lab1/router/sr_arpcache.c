@@ -11,109 +11,395 @@
 #include "sr_if.h"
 #include "sr_protocol.h"
 #include "sr_rt.h"
+#include "sr_afpacket.h"
 
 static volatile int keep_running_arpcache = 1;
 
-char* getSendBackInterface(struct sr_if* ifList, struct sr_packet *packetItem)
+/* Queue slot size: headroom for the VNS header plus the frame, rounded up
+   to a cache line. */
+#define ARPQ_SLOT_STRIDE \
+    ((SR_PACKET_HEADROOM + SR_ARPQ_SLOT_LEN + 63) & ~(size_t)63)
+
+#define ARP_TO_MS ((unsigned int)(SR_ARPCACHE_TO * 1000))
+
+static uint64_t arp_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Takes the (recursive) cache lock, timing the wait and, for the
+   outermost hold, how long the lock is kept. */
+void sr_arpcache_lock(struct sr_arpcache *cache) {
+    uint64_t start = arp_now_ns();
+    
+    pthread_mutex_lock(&(cache->lock));
+    if (cache->lock_depth++ == 0) {
+        uint64_t now = arp_now_ns();
+        if (now - start > cache->lock_wait_max_ns)
+            cache->lock_wait_max_ns = now - start;
+        cache->lock_since_ns = now;
+    }
+}
+
+void sr_arpcache_unlock(struct sr_arpcache *cache) {
+    if (--cache->lock_depth == 0) {
+        uint64_t held = arp_now_ns() - cache->lock_since_ns;
+        cache->lock_holds++;
+        cache->lock_hold_ns += held;
+        if (held > cache->lock_hold_max_ns)
+            cache->lock_hold_max_ns = held;
+    }
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+struct sr_if* getSendBackInterface(struct sr_instance* sr, struct sr_packet *packetItem)
 {
     sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)packetItem->buf;
-    uint8_t *ethAddr = ethData->ether_dhost;
-    while(ifList)
+
+    /* the frame still carries the MAC of the interface it arrived on */
+    return sr_get_interface_by_mac(sr, ethData->ether_dhost);
+}
+
+/* 
+  ARP work decided under the cache lock and carried out after it has been
+  released, so no packet is written while the lock is held.
+*/
+struct sr_arpsend {
+    uint32_t ip;
+    int ifindex;
+    int unicast;                    /* refresh: ask mac directly */
+    unsigned char mac[ETHER_ADDR_LEN];
+};
+
+struct sr_arpwork {
+    struct sr_instance *sr;
+    struct sr_arpsend *sends;       /* ARP requests to send */
+    unsigned int num_sends;
+    unsigned int cap_sends;
+    struct sr_arpsend fixed[1];     /* a miss records at most one send */
+    struct sr_arpreq *unreachable;  /* given up, already off the queue */
+};
+
+static void arpWorkInit(struct sr_arpwork *work, struct sr_instance *sr)
+{
+    work->sr = sr;
+    work->sends = work->fixed;
+    work->num_sends = 0;
+    work->cap_sends = sizeof(work->fixed) / sizeof(work->fixed[0]);
+    work->unreachable = NULL;
+}
+
+static void arpWorkFree(struct sr_arpwork *work)
+{
+    if(work->sends != work->fixed)
+        free(work->sends);
+}
+
+static void arpWorkRun(struct sr_arpwork *work)
+{
+    struct sr_instance *sr = work->sr;
+    unsigned int i;
+
+    for(i = 0; i < work->num_sends; i++)
+    {
+        struct sr_arpsend *send = &(work->sends[i]);
+        sendARPReuqest(sr, send->ifindex, send->ip, send->unicast ? send->mac : NULL);
+    }
+    work->num_sends = 0;
+
+    while(work->unreachable)
     {
-        int i;
-        int isFailed = 0;
-        for(i = 0; i < 6; i++)
+        struct sr_arpreq *reqItem = work->unreachable;
+        work->unreachable = reqItem->next;
+
+        struct sr_packet *packetItem = reqItem->packets;
+        while(packetItem)
         {
-            if(ethAddr[i] != (ifList->addr)[i])
+            struct sr_if* interface = getSendBackInterface(sr, packetItem);
+            if(interface)
             {
-                isFailed = 1;
-                break;
+                generateICMP(sr, packetItem->buf, packetItem->len, interface, TYPE_DST_UNREACHABLE, HOST_UNREACHABLE);
             }
+        
+            packetItem = packetItem->next;
         }
-        if(isFailed == 0)
+        
+        sr_arpreq_destroy(&(sr->cache), reqItem);
+    }
+}
+
+/* 
+  Returns room for one more send, or NULL if it cannot be had; the
+  request is then simply not sent this time. Past the fixed array the
+  sends move to the heap, which only the cache thread gets to, and it
+  keeps the block from tick to tick.
+*/
+static struct sr_arpsend *arpWorkAddSend(struct sr_arpwork *work)
+{
+    if(work->num_sends == work->cap_sends)
+    {
+        unsigned int cap = 2 * work->cap_sends < 8 ? 8 : 2 * work->cap_sends;
+        struct sr_arpsend *sends;
+
+        if(work->sends == work->fixed)
         {
-            return ifList->name;
+            sends = (struct sr_arpsend *)malloc(cap * sizeof(struct sr_arpsend));
+            if(sends)
+                memcpy(sends, work->fixed, sizeof(work->fixed));
         }
-        ifList = ifList->next;
+        else
+            sends = (struct sr_arpsend *)realloc(work->sends, cap * sizeof(struct sr_arpsend));
+        if(!sends)
+            return NULL;
+        work->sends = sends;
+        work->cap_sends = cap;
     }
-
-    return NULL;
+    return &(work->sends[work->num_sends++]);
 }
 
-void handle_arpReq(struct sr_instance *sr, struct sr_arpreq *reqItem)
+/* 
+  Decides what reqItem needs next. Called with the cache lock held; the
+  resulting I/O is only recorded in work.
+*/
+static void arpReqDecide(struct sr_arpcache *cache, struct sr_arpreq *reqItem, struct sr_arpwork *work)
 {
-    struct timeval tv ;
-    gettimeofday(&tv, NULL);
-    if(tv.tv_sec - reqItem->sent >= 1)
+    /* a retry is already scheduled, its timer calls back here */
+    if(sr_timer_pending(&(reqItem->timer)))
+        return;
+
+    if(reqItem->times_sent >= SR_ARPREQ_MAX_SENT)
+    { 
+        sr_arpreq_unlink(cache, reqItem);
+        reqItem->next = work->unreachable;
+        work->unreachable = reqItem;
+    }
+    else
     {
-        if(reqItem->times_sent >= 5)
-        { 
-            struct sr_packet *packetItem = reqItem->packets;
-            while(packetItem)
+        if(reqItem->ifindex >= 0)
+        {
+            struct sr_arpsend *send = arpWorkAddSend(work);
+            if(send)
             {
-                char* interface = getSendBackInterface(sr->if_list, packetItem);
-                if(interface)
-                {
-                    generateICMP(sr, packetItem->buf, packetItem->len, interface, TYPE_DST_UNREACHABLE, HOST_UNREACHABLE);
-                }
-            
-                packetItem = packetItem->next;
+                send->ip = reqItem->ip;
+                send->ifindex = reqItem->ifindex;
+                send->unicast = 0;
             }
-            
-            sr_arpreq_destroy(&(sr->cache), reqItem);
-    
-        }
-        else if(reqItem->times_sent < 5)
-        {
-            sendARPReuqest(sr, reqItem->packets,reqItem->ip);
-            reqItem->sent = tv.tv_sec;
-            (reqItem->times_sent)++;
         }
+        reqItem->sent = sr_clock_ms();
+        (reqItem->times_sent)++;
+        sr_timer_add(&(cache->timers), &(reqItem->timer), SR_ARPREQ_RETRY_MS);
     }
 }
 
+void handle_arpMiss(struct sr_instance *sr, uint32_t ip, uint8_t *packet, unsigned int len, int ifindex)
+{
+    struct sr_arpwork work;
+    arpWorkInit(&work, sr);
+
+    /* queue and decide in one critical section, so the cache thread
+       cannot give up on the request in between */
+    sr_arpcache_lock(&(sr->cache));
+    struct sr_arpreq *reqItem = sr_arpcache_queuereq(&(sr->cache), ip, packet, len, ifindex);
+    if(reqItem)
+        arpReqDecide(&(sr->cache), reqItem, &work);
+    sr_arpcache_unlock(&(sr->cache));
+
+    arpWorkRun(&work);
+}
 
 /* 
-  This function gets called every second. For each request sent out, we keep
-  checking whether we should resend an request or destroy the arp request.
-  See the comments in the header file for an idea of what it should look like.
+  Retry timer of a request. Runs on the cache thread with the cache lock
+  held, one second after the request was last sent.
 */
-void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
-    struct sr_arpreq *reqItem = sr->cache.requests;
-    while(reqItem)
-    {
-        struct sr_arpreq* nextReq = reqItem->next;
-        handle_arpReq(sr, reqItem);
-        reqItem = nextReq;
-    }
+static void arpReqTimeout(struct sr_timer *timer, void *work_ptr)
+{
+    struct sr_arpwork *work = work_ptr;
+    arpReqDecide(&(work->sr->cache), (struct sr_arpreq *)timer->arg, work);
 }
 
 /* You should not need to touch the rest of this code. */
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
+/* Bucket of ip in both the entry index and the request hash. */
+static unsigned int arp_hash(const struct sr_arpcache *cache, uint32_t ip) {
+    uint32_t h = ip * 2654435761u;
+    return (h ^ (h >> 16)) & cache->index_mask;
+}
+
+/* Writers bracket every change to entries/index with these so that
+   concurrent readers notice and retry. Caller holds the lock. */
+static void arp_write_begin(struct sr_arpcache *cache) {
+    cache->seq++;
+    __sync_synchronize();
+}
+
+static void arp_write_end(struct sr_arpcache *cache) {
+    __sync_synchronize();
+    cache->seq++;
+}
+
+/* Position of ip in the index, or -1. Caller holds the lock. */
+static int arp_index_find(struct sr_arpcache *cache, uint32_t ip) {
+    unsigned int i = arp_hash(cache, ip);
+    int slot;
     
-    struct sr_arpentry *entry = NULL, *copy = NULL;
+    while ((slot = cache->index[i]) >= 0) {
+        if (cache->entries[slot].ip == ip)
+            return i;
+        i = (i + 1) & cache->index_mask;
+    }
+    return -1;
+}
+
+/* Invalidates the entry in slot and returns the slot to the free stack.
+   The index hole is closed by shifting later probes back, so no
+   tombstones build up. Caller holds the lock inside a write section. */
+static void arp_entry_remove(struct sr_arpcache *cache, int slot) {
+    unsigned int mask = cache->index_mask;
+    unsigned int i, j, k;
+    int pos = arp_index_find(cache, cache->entries[slot].ip);
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+    if (pos >= 0) {
+        i = j = pos;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (cache->index[j] < 0)
+                break;
+            k = arp_hash(cache, cache->entries[cache->index[j]].ip);
+            /* entry at j may stay if its home bucket lies in (i, j] */
+            if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+                continue;
+            cache->index[i] = cache->index[j];
+            i = j;
         }
+        cache->index[i] = -1;
     }
     
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
+    sr_timer_del(&(cache->entry_timers[slot]));
+    cache->entries[slot].valid = 0;
+    cache->used--;
+    cache->free_slots[cache->size - cache->used - 1] = slot;
+}
+
+/* Timer of an entry. Fires SR_ARPCACHE_REFRESH_MS before the entry expires
+   and then every retry interval: while the entry has been used since it
+   was added a unicast request is sent to its MAC, which keeps answering
+   lookups until the reply renews it or the deadline passes. Runs on the
+   cache thread with the lock held. */
+static void arp_entry_timer(struct sr_timer *timer, void *work_ptr) {
+    struct sr_arpcache *cache = timer->arg;
+    struct sr_arpentry *entry = &(cache->entries[timer - cache->entry_timers]);
+    uint64_t now = sr_clock_ms();
+    uint64_t deadline = entry->added + ARP_TO_MS;
+    
+    if (now < deadline) {
+        if (entry->last_used > entry->added && entry->ifindex >= 0) {
+            struct sr_arpsend *send = arpWorkAddSend(work_ptr);
+            if (send) {
+                send->ip = entry->ip;
+                send->ifindex = entry->ifindex;
+                send->unicast = 1;
+                memcpy(send->mac, entry->mac, ETHER_ADDR_LEN);
+            }
+        }
+        sr_timer_add(&(cache->timers), timer,
+                     deadline - now < SR_ARPREQ_RETRY_MS ? deadline - now : SR_ARPREQ_RETRY_MS);
+        return;
     }
+    
+    arp_write_begin(cache);
+    arp_entry_remove(cache, timer - cache->entry_timers);
+    arp_write_end(cache);
+    
+    /* Adjacencies resolved before this point may be stale now */
+    __sync_fetch_and_add(&(cache->gen), 1);
+}
+
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   On a hit the entry is copied to *out and 1 is returned, otherwise 0.
+   Never locks: the copy is retried if a writer was active meanwhile. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip,
+                       struct sr_arpentry *out) {
+    unsigned int seq, i, n;
+    int slot, found;
+    
+    for (;;) {
+        seq = cache->seq;
+        __sync_synchronize();
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
         
-    pthread_mutex_unlock(&(cache->lock));
+        found = -1;
+        i = arp_hash(cache, ip);
+        for (n = 0; n <= cache->index_mask; n++) {
+            slot = cache->index[i];
+            if (slot < 0)
+                break;
+            if (cache->entries[slot].ip == ip) {
+                memcpy(out, &(cache->entries[slot]), sizeof(*out));
+                found = slot;
+                break;
+            }
+            i = (i + 1) & cache->index_mask;
+        }
+        
+        __sync_synchronize();
+        if (cache->seq == seq)
+            break;
+    }
+    
+    if (found < 0 || !out->valid)
+        return 0;
+    
+    sr_arpcache_touch(cache, found + 1, ip);
+    return found + 1;
+}
+
+void sr_arpcache_touch(struct sr_arpcache *cache, int handle, uint32_t ip) {
+    /* racy stores are fine, both only steer eviction and refresh */
+    uint64_t now = sr_clock_ms();
+    struct sr_arpentry *entry;
+    unsigned int seq;
+    int same;
     
-    return copy;
+    if (handle <= 0)
+        return;
+    entry = &(cache->entries[handle - 1]);
+    
+    /* the slot may have been evicted and reused since the handle was
+       taken; a writer mid-update just means this frame does not count */
+    seq = cache->seq;
+    __sync_synchronize();
+    if (seq & 1)
+        return;
+    same = entry->ip == ip && entry->valid;
+    __sync_synchronize();
+    if (!same || cache->seq != seq)
+        return;
+    
+    if (entry->last_used != now)
+        entry->last_used = now;
+    if (!entry->referenced)
+        entry->referenced = 1;
+}
+
+/* Picks the slot a full cache gives up: the first one the hand finds
+   unreferenced, clearing the flag of those it passes, or the one it
+   reaches after SR_ARPCACHE_CLOCK_SCAN second chances. Caller holds
+   the lock. */
+static int arp_clock_victim(struct sr_arpcache *cache) {
+    unsigned int n;
+    int slot;
+    
+    for (n = 0; ; n++) {
+        slot = cache->hand;
+        cache->hand = (cache->hand + 1) % cache->size;
+        if (!cache->entries[slot].referenced || n == SR_ARPCACHE_CLOCK_SCAN)
+            return slot;
+        cache->entries[slot].referenced = 0;
+    }
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
@@ -121,17 +407,19 @@ struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
    that corresponds to this ARP request. You should free the passed *packet.
    
    A pointer to the ARP request is returned; it should not be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+   NULL means a new request was needed and the pool had none left. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
-                                       char *iface)
+                                       int ifindex)
 {
-    pthread_mutex_lock(&(cache->lock));
+    sr_arpcache_lock(cache);
     
+    struct sr_arpreq **bucket = &(cache->requests[arp_hash(cache, ip)]);
     struct sr_arpreq *req;
-    for (req = cache->requests; req != NULL; req = req->next) {
+    for (req = *bucket; req != NULL; req = req->next) {
         if (req->ip == ip) {
             break;
         }
@@ -139,26 +427,49 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
     
     /* If the IP wasn't found, add it */
     if (!req) {
-        req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
+        if (!cache->req_free) {
+            cache->drops_no_req++;
+            sr_arpcache_unlock(cache);
+            return NULL;
+        }
+        req = cache->req_free;
+        cache->req_free = req->next;
+        memset(req, 0, sizeof(struct sr_arpreq));
         req->ip = ip;
-        req->next = cache->requests;
-        cache->requests = req;
+        req->ifindex = ifindex;
+        sr_timer_init(&(req->timer), arpReqTimeout, req);
+        req->next = *bucket;
+        *bucket = req;
     }
     
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
-        
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
-        memcpy(new_pkt->buf, packet, packet_len);
-        new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = req->packets;
-        req->packets = new_pkt;
+    /* Add the packet to the end of the list of packets for this request */
+    if (packet && packet_len && ifindex >= 0) {
+        if (req->bytes + packet_len > SR_ARPREQ_MAX_BYTES) {
+            cache->drops_req_cap++;
+        }
+        else if (!cache->pkt_free || packet_len > SR_ARPQ_SLOT_LEN ||
+                 cache->queued_bytes + packet_len > SR_ARPQ_MAX_BYTES) {
+            cache->drops_queue_cap++;
+        }
+        else {
+            struct sr_packet *new_pkt = cache->pkt_free;
+            cache->pkt_free = new_pkt->next;
+            
+            memcpy(new_pkt->buf, packet, packet_len);
+            new_pkt->len = packet_len;
+            new_pkt->ifindex = ifindex;
+            new_pkt->next = NULL;
+            if (req->tail)
+                req->tail->next = new_pkt;
+            else
+                req->packets = new_pkt;
+            req->tail = new_pkt;
+            req->bytes += packet_len;
+            cache->queued_bytes += packet_len;
+        }
     }
     
-    pthread_mutex_unlock(&(cache->lock));
+    sr_arpcache_unlock(cache);
     
     return req;
 }
@@ -169,108 +480,185 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip)
+                                     uint32_t ip,
+                                     int ifindex,
+                                     int *handle,
+                                     unsigned int *gen)
 {
-    pthread_mutex_lock(&(cache->lock));
+    sr_arpcache_lock(cache);
     
-    struct sr_arpreq *req, *prev = NULL, *next = NULL; 
-    for (req = cache->requests; req != NULL; req = req->next) {
-        if (req->ip == ip) {            
-            if (prev) {
-                next = req->next;
-                prev->next = next;
-            } 
-            else {
-                next = req->next;
-                cache->requests = next;
-            }
-            
+    struct sr_arpreq **link = &(cache->requests[arp_hash(cache, ip)]);
+    struct sr_arpreq *req;
+    for (req = *link; req != NULL; link = &(req->next), req = req->next) {
+        if (req->ip == ip) {
+            *link = req->next;
+            sr_timer_del(&(req->timer));
             break;
         }
-        prev = req;
     }
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
-    }
+    uint64_t now = sr_clock_ms();
+    int slot, pos;
+    
+    arp_write_begin(cache);
     
-    if (i != SR_ARPCACHE_SZ) {
-        memcpy(cache->entries[i].mac, mac, 6);
-        cache->entries[i].ip = ip;
-        cache->entries[i].added = time(NULL);
-        cache->entries[i].valid = 1;
+    pos = arp_index_find(cache, ip);
+    if (pos >= 0) {
+        slot = cache->index[pos];
+    }
+    else {
+        if (cache->used == cache->size) {
+            /* Full: evict one the traffic has not been using. */
+            arp_entry_remove(cache, arp_clock_victim(cache));
+            cache->evictions++;
+            __sync_fetch_and_add(&(cache->gen), 1);
+        }
+        
+        slot = cache->free_slots[cache->size - cache->used - 1];
+        cache->used++;
+        
+        unsigned int i = arp_hash(cache, ip);
+        while (cache->index[i] >= 0)
+            i = (i + 1) & cache->index_mask;
+        cache->index[i] = slot;
     }
     
-    pthread_mutex_unlock(&(cache->lock));
+    memcpy(cache->entries[slot].mac, mac, 6);
+    cache->entries[slot].ip = ip;
+    cache->entries[slot].added = now;
+    cache->entries[slot].last_used = now;
+    /* an address nobody sends to yet goes first, a scan cannot push
+       out the next hops in use */
+    if (pos < 0)
+        cache->entries[slot].referenced = 0;
+    if (ifindex >= 0 || pos < 0)
+        cache->entries[slot].ifindex = ifindex;
+    cache->entries[slot].valid = 1;
+    sr_timer_add(&(cache->timers), &(cache->entry_timers[slot]),
+                 ARP_TO_MS - SR_ARPCACHE_REFRESH_MS);
+    
+    arp_write_end(cache);
+    
+    /* evictions take the lock, so the slot is ours for this generation */
+    *handle = slot + 1;
+    *gen = cache->gen;
+    sr_arpcache_unlock(cache);
     
     return req;
 }
 
-/* Frees all memory associated with this arp request entry. If this arp request
-   entry is on the arp request queue, it is removed from the queue. */
+/* Takes a request off the queue and cancels its retry timer, if it is
+   still queued. Caller holds the lock. */
+void sr_arpreq_unlink(struct sr_arpcache *cache, struct sr_arpreq *entry) {
+    struct sr_arpreq **link = &(cache->requests[arp_hash(cache, entry->ip)]);
+    struct sr_arpreq *req;
+    for (req = *link; req != NULL; link = &(req->next), req = req->next) {
+        if (req == entry) {
+            *link = req->next;
+            break;
+        }
+    }
+    sr_timer_del(&(entry->timer));
+}
+
+/* Hands this arp request entry and its packet slots back to their pools. If
+   this arp request entry is on the arp request queue, it is removed from the
+   queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
-    pthread_mutex_lock(&(cache->lock));
+    sr_arpcache_lock(cache);
     
     if (entry) {
-        struct sr_arpreq *req, *prev = NULL, *next = NULL; 
-        for (req = cache->requests; req != NULL; req = req->next) {
-            if (req == entry) {                
-                if (prev) {
-                    next = req->next;
-                    prev->next = next;
-                } 
-                else {
-                    next = req->next;
-                    cache->requests = next;
-                }
-                
-                break;
-            }
-            prev = req;
-        }
-        
-        struct sr_packet *pkt, *nxt;
+        sr_arpreq_unlink(cache, entry);
         
-        for (pkt = entry->packets; pkt; pkt = nxt) {
-            nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
+        /* hand the packet slots back to the pool */
+        if (entry->tail) {
+            entry->tail->next = cache->pkt_free;
+            cache->pkt_free = entry->packets;
         }
+        cache->queued_bytes -= entry->bytes;
         
-        free(entry);
+        entry->next = cache->req_free;
+        cache->req_free = entry;
     }
     
-    pthread_mutex_unlock(&(cache->lock));
+    sr_arpcache_unlock(cache);
 }
 
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache) {
-    fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
-    fprintf(stderr, "-----------------------------------------------------------\n");
+    fprintf(stderr, "\nMAC            IP         AGE (ms)     VALID\n");
+    fprintf(stderr, "---------------------------------------------\n");
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+    uint64_t now = sr_clock_ms();
+    unsigned int i;
+    for (i = 0; i < cache->size; i++) {
         struct sr_arpentry *cur = &(cache->entries[i]);
         unsigned char *mac = cur->mac;
-        fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
+        fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %-10lu   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), cur->valid ? (unsigned long)(now - cur->added) : 0UL, cur->valid);
     }
     
-    fprintf(stderr, "\n");
+    fprintf(stderr, "%u of %u entries used, %lu evictions\n\n", cache->used, cache->size, cache->evictions);
 }
 
 /* Initialize table + table lock. Returns 0 on success. */
-int sr_arpcache_init(struct sr_arpcache *cache) {  
-    /* Seed RNG to kick out a random entry if all entries full. */
-    srand(time(NULL));
+int sr_arpcache_init(struct sr_arpcache *cache, unsigned int size) {  
+    unsigned int i, buckets = 16;
+    
+    if (size == 0)
+        size = SR_ARPCACHE_SZ;
+    /* keep the index at most half full so probe runs stay short */
+    while (buckets < 2 * size)
+        buckets <<= 1;
     
     /* Invalidate all entries */
-    memset(cache->entries, 0, sizeof(cache->entries));
-    cache->requests = NULL;
+    cache->entries = (struct sr_arpentry *) calloc(size, sizeof(struct sr_arpentry));
+    cache->index = (int *) malloc(buckets * sizeof(int));
+    cache->free_slots = (int *) malloc(size * sizeof(int));
+    cache->entry_timers = (struct sr_timer *) malloc(size * sizeof(struct sr_timer));
+    cache->requests = (struct sr_arpreq **) calloc(buckets, sizeof(struct sr_arpreq *));
+    cache->pkt_slots = (struct sr_packet *) calloc(SR_ARPQ_SLOTS, sizeof(struct sr_packet));
+    cache->pkt_bufs = (uint8_t *) malloc(SR_ARPQ_SLOTS * ARPQ_SLOT_STRIDE);
+    cache->req_slots = (struct sr_arpreq *) calloc(SR_ARPREQ_SLOTS, sizeof(struct sr_arpreq));
+    if (!cache->entries || !cache->index || !cache->free_slots ||
+        !cache->entry_timers || !cache->requests ||
+        !cache->pkt_slots || !cache->pkt_bufs || !cache->req_slots)
+        return -1;
+    
+    cache->pkt_free = NULL;
+    for (i = SR_ARPQ_SLOTS; i-- > 0; ) {
+        cache->pkt_slots[i].buf = cache->pkt_bufs + i * ARPQ_SLOT_STRIDE + SR_PACKET_HEADROOM;
+        cache->pkt_slots[i].next = cache->pkt_free;
+        cache->pkt_free = &(cache->pkt_slots[i]);
+    }
+    cache->req_free = NULL;
+    for (i = SR_ARPREQ_SLOTS; i-- > 0; ) {
+        cache->req_slots[i].next = cache->req_free;
+        cache->req_free = &(cache->req_slots[i]);
+    }
+    cache->queued_bytes = 0;
+    cache->drops_req_cap = 0;
+    cache->drops_queue_cap = 0;
+    cache->drops_no_req = 0;
+    cache->lock_depth = 0;
+    cache->lock_holds = 0;
+    cache->lock_hold_ns = 0;
+    cache->lock_hold_max_ns = 0;
+    cache->lock_wait_max_ns = 0;
+    
+    for (i = 0; i < buckets; i++)
+        cache->index[i] = -1;
+    for (i = 0; i < size; i++) {
+        cache->free_slots[i] = size - 1 - i;
+        sr_timer_init(&(cache->entry_timers[i]), arp_entry_timer, cache);
+    }
+    sr_timerwheel_init(&(cache->timers));
+    cache->size = size;
+    cache->used = 0;
+    cache->index_mask = buckets - 1;
+    cache->hand = 0;
+    cache->seq = 0;
+    cache->gen = 1;
+    cache->evictions = 0;
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
@@ -281,36 +669,73 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
 }
 
 /* Destroys table + table lock. Returns 0 on success. */
+/* Returns 0, or the first error of the two pthread destroys. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
+    int lock_err, attr_err;
+
+    sr_arpcache_lock(cache);
     keep_running_arpcache = 0;
-    return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
+    free(cache->entries);
+    free(cache->index);
+    free(cache->free_slots);
+    free(cache->entry_timers);
+    free(cache->requests);
+    free(cache->pkt_slots);
+    free(cache->pkt_bufs);
+    free(cache->req_slots);
+    cache->entries = NULL;
+    cache->size = 0;
+    sr_arpcache_unlock(cache);
+
+    /* both are destroyed even if the first fails */
+    lock_err = pthread_mutex_destroy(&(cache->lock));
+    attr_err = pthread_mutexattr_destroy(&(cache->attr));
+    return lock_err ? lock_err : attr_err;
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+/* Stops the cache thread and joins it. Safe to call more than once and
+   before the thread was ever started. */
+void sr_arpcache_stop(struct sr_arpcache *cache) {
+    keep_running_arpcache = 0;
+    if (!cache->thread_running)
+        return;
+    cache->thread_running = 0;
+    if (!pthread_equal(cache->thread, pthread_self()))
+        pthread_join(cache->thread, NULL);
+}
+
+/* Thread which advances the timer wheel, expiring entries and retrying
+   requests as their deadlines pass. Packets the timers call for are sent
+   once the lock has been dropped. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
     struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpwork work;
     
-    while (keep_running_arpcache) {
-        sleep(1.0);
-        
-        pthread_mutex_lock(&(cache->lock));
+    arpWorkInit(&work, sr);
     
-        time_t curtime = time(NULL);
+    while (keep_running_arpcache) {
+        usleep(SR_TIMER_TICK_MS * 1000);
         
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
+        sr_arpcache_lock(cache);
+        if (!keep_running_arpcache) {
+            sr_arpcache_unlock(cache);
+            break;
         }
         
-        sr_arpcache_sweepreqs(sr);
+        sr_clock_update();
+        sr_timerwheel_run(&(cache->timers), &work);
 
-        pthread_mutex_unlock(&(cache->lock));
+        sr_arpcache_unlock(cache);
+        
+        arpWorkRun(&work);
+        /* the main thread may be asleep in epoll with nothing to flush them */
+        if (sr->afp)
+            sr_afpacket_flush(sr->afp);
+        else
+            sr_tx_flush(&(sr->tx));
     }
     
+    arpWorkFree(&work);
     return NULL;
 }
-
@@ -2,29 +2,32 @@
    request queue, and ARP cache entries. The ARP request queue holds data about
    an outgoing ARP cache request and the packets that are waiting on a reply
    to that ARP cache request. The ARP cache entries hold IP->MAC mappings and
-   are timed out every SR_ARPCACHE_TO seconds.
+   are timed out SR_ARPCACHE_TO seconds after they were added. An entry that
+   is still being used gets a unicast ARP request SR_ARPCACHE_REFRESH_MS
+   before that; the reply renews it and the old MAC stays in use meanwhile.
+
+   Both are driven by timers on a wheel (sr_timer.h) that the cache thread
+   advances every SR_TIMER_TICK_MS; times are on the cached monotonic clock
+   sr_clock_ms().
 
    Pseudocode for use of these structures follows.
 
    --
 
    # When sending packet to next_hop_ip
-   entry = arpcache_lookup(next_hop_ip)
-
-   if entry:
+   if arpcache_lookup(next_hop_ip, &entry):
        use next_hop_ip->mac mapping in entry to send the packet
-       free entry
    else:
-       req = arpcache_queuereq(next_hop_ip, packet, len)
-       handle_arpreq(req)
+       handle_arpmiss(next_hop_ip, packet, len)
 
    --
 
-   The handle_arpreq() function is a function you should write, and it should
-   handle sending ARP requests if necessary:
+   handle_arpmiss() queues the packet and runs handle_arpreq() on the request
+   in one critical section. handle_arpreq() handles sending ARP requests if
+   necessary; it is also what a request's retry timer runs:
 
    function handle_arpreq(req):
-       if difftime(now, req->sent) >= 1.0
+       if req->timer is not pending:
            if req->times_sent >= 5:
                send icmp host unreachable to source addr of all pkts waiting
                  on this request
@@ -33,6 +36,10 @@
                send arp request
                req->sent = now
                req->times_sent++
+               arm req->timer to call handle_arpreq(req) in 1 second
+
+   Both run with the cache lock held, so the packets they call for are only
+   recorded and get sent once the lock has been released.
 
    --
 
@@ -48,19 +55,10 @@
 
    --
 
-   To meet the guidelines in the assignment (ARP requests are sent every second
-   until we send 5 ARP requests, then we send ICMP host unreachable back to
-   all packets waiting on this ARP request), you must fill out the following
-   function that is called every second and is defined in sr_arpcache.c:
-
-   void sr_arpcache_sweepreqs(struct sr_instance *sr) {
-       for each request on sr->cache.requests:
-           handle_arpreq(request)
-   }
-
-   Since handle_arpreq as defined in the comments above could destroy your
-   current request, make sure to save the next pointer before calling
-   handle_arpreq when traversing through the ARP requests linked list.
+   This meets the guidelines in the assignment (ARP requests are sent every
+   second until we send 5 ARP requests, then we send ICMP host unreachable
+   back to all packets waiting on this ARP request) without sweeping every
+   request: each one is only looked at when its own timer fires.
  */
 
 #ifndef SR_ARPCACHE_H
@@ -70,71 +68,165 @@
 #include <time.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_timer.h"
 
-#define SR_ARPCACHE_SZ    100  
+#define SR_ARPCACHE_SZ    100  /* default entries, see sr_arpcache_init */
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_REFRESH_MS 3000 /* refresh window before expiry */
+#define SR_ARPREQ_RETRY_MS 1000 /* between ARP requests for one IP */
+#define SR_ARPREQ_MAX_SENT 5    /* requests before giving up */
+#define SR_ARPCACHE_CLOCK_SCAN 8 /* second chances per eviction */
+
+/* Packets waiting on ARP are copied into slots from a pool preallocated at
+   init. A packet is dropped instead of queued once its request or the
+   whole queue would go over the byte caps below. Requests come from a
+   pool of their own; while all are pending a miss for yet another
+   address is dropped. */
+#define SR_ARPQ_SLOTS       512
+#define SR_ARPQ_SLOT_LEN    1600             /* largest frame a slot holds */
+#define SR_ARPQ_MAX_BYTES   (256 * 1024)     /* all pending requests */
+#define SR_ARPREQ_MAX_BYTES (32 * 1024)      /* one pending request */
+#define SR_ARPREQ_SLOTS     256              /* addresses resolved at once */
 
 struct sr_packet {
-    uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
+    uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty,
+                                   in a pool slot with SR_PACKET_HEADROOM in front */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    int ifindex;                /* The outgoing interface towards the request's IP */
     struct sr_packet *next;
 };
 
 struct sr_arpentry {
     unsigned char mac[6]; 
     uint32_t ip;                /* IP addr in network byte order */
-    time_t added;         
+    uint64_t added;             /* sr_clock_ms() when inserted */
+    uint64_t last_used;         /* for refresh */
+    int referenced;             /* used since the clock hand last passed */
+    int ifindex;                /* where ip was learned, refreshes go out here;
+                                   -1 if unknown */
     int valid;
 };
 
 struct sr_arpreq {
     uint32_t ip;
-    time_t sent;                /* Last time this ARP request was sent. You 
-                                   should update this. If the ARP request was 
+    int ifindex;                /* where ARP requests for ip go out, -1 if none */
+    uint64_t sent;              /* Last time this ARP request was sent, in
+                                   sr_clock_ms(). If the ARP request was
                                    never sent, will be 0. */
     uint32_t times_sent;        /* Number of times this request was sent. You 
                                    should update this. */
-    struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
-    struct sr_arpreq *next;
+    struct sr_packet *packets;  /* List of pkts waiting on this req to finish,
+                                   oldest first */
+    struct sr_packet *tail;     /* last packet on the list, where new ones go */
+    unsigned int bytes;         /* frame bytes queued on this request */
+    struct sr_arpreq *next;     /* next request in the same hash bucket */
+    struct sr_timer timer;      /* next retry, pending once the first is sent */
 };
 
+/* Entries live in a fixed array sized at init and are found through an
+   open-addressing (linear probing) index of slot numbers keyed by IP.
+   Writers hold the lock and bump seq around every change; readers only
+   retry while seq is odd or moved, so lookups never lock or allocate.
+   A full cache evicts by CLOCK: the hand walks the slots, clearing the
+   referenced flag lookups set, and takes the first entry not used since
+   it last came by, or the one it stops at after SR_ARPCACHE_CLOCK_SCAN
+   second chances. */
 struct sr_arpcache {
-    struct sr_arpentry entries[SR_ARPCACHE_SZ];
-    struct sr_arpreq *requests;
+    struct sr_arpentry *entries;
+    unsigned int size;          /* slots in entries */
+    unsigned int used;          /* valid entries */
+    int *index;                 /* slot number or -1, index_mask + 1 long */
+    int *free_slots;            /* stack of unused slot numbers */
+    struct sr_timer *entry_timers; /* expiry of entries[i] */
+    unsigned int index_mask;
+    unsigned int hand;          /* next slot the eviction clock looks at */
+    struct sr_arpreq **requests;/* pending requests, index_mask + 1 buckets */
+    struct sr_timerwheel timers;/* entry expiry and request retries */
+    volatile unsigned int seq;  /* odd while a writer is mid-update */
+    volatile unsigned int gen;  /* bumped whenever entries expire or are evicted */
+    unsigned long evictions;
+    struct sr_packet *pkt_slots;/* SR_ARPQ_SLOTS queue slots */
+    uint8_t *pkt_bufs;          /* their frame buffers */
+    struct sr_packet *pkt_free; /* unused slots */
+    struct sr_arpreq *req_slots;/* SR_ARPREQ_SLOTS requests */
+    struct sr_arpreq *req_free; /* unused requests, chained by next */
+    unsigned int queued_bytes;  /* frame bytes queued on all requests */
+    unsigned long drops_req_cap;    /* request over SR_ARPREQ_MAX_BYTES */
+    unsigned long drops_queue_cap;  /* out of slots or over SR_ARPQ_MAX_BYTES */
+    unsigned long drops_no_req;     /* all SR_ARPREQ_SLOTS requests pending */
+    unsigned int lock_depth;    /* recursion depth of the current holder */
+    uint64_t lock_since_ns;     /* start of the current outermost hold */
+    unsigned long lock_holds;   /* outermost holds so far */
+    uint64_t lock_hold_ns;      /* their total duration */
+    uint64_t lock_hold_max_ns;
+    uint64_t lock_wait_max_ns;  /* longest wait to acquire */
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
+    pthread_t thread;           /* runs sr_arpcache_timeout() */
+    int thread_running;         /* until sr_arpcache_stop() joined it */
 };
 
-void handle_arpReq(struct sr_instance *sr, struct sr_arpreq *reqItem);
+/* Queues packet, which is to leave on interface ifindex, until ip is
+   resolved and sends the first ARP request for ip if none is in flight. */
+void handle_arpMiss(struct sr_instance *sr, uint32_t ip, uint8_t *packet,
+                    unsigned int len, int ifindex);
+
+/* Cache lock, recursive. Also keeps the hold/wait time statistics. */
+void sr_arpcache_lock(struct sr_arpcache *cache);
+void sr_arpcache_unlock(struct sr_arpcache *cache);
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   On a hit the entry is copied to *out and a nonzero handle for
+   sr_arpcache_touch() is returned, otherwise 0. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip,
+                       struct sr_arpentry *out);
+
+/* Marks the entry behind handle as in use, so it is refreshed before it
+   expires. Nothing is marked if the slot no longer holds ip, which
+   happens once the cache generation has changed. */
+void sr_arpcache_touch(struct sr_arpcache *cache, int handle, uint32_t ip);
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
-   the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. The packet argument should not be
-   freed by the caller.
+   the queue, appends a copy of the packet to the list of packets for this
+   sr_arpreq that corresponds to this ARP request, unless that would exceed
+   the queue caps, in which case the packet is counted and dropped. ifindex
+   is the interface the packet leaves on once ip has been resolved. packet
+   may be NULL to only create the request.
 
    A pointer to the ARP request is returned; it should not be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+   NULL is returned, and the packet counted and dropped, if a new request
+   is needed and none is left in the pool. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
-                         char *iface);
+                         int ifindex);
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
       to the sr_arpreq with this IP. Otherwise, returns NULL.
-   2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
+   2) Inserts this IP to MAC mapping in the cache, and marks it valid. An
+      existing mapping for the IP is updated; if the cache is full an entry
+      not used lately is evicted, in constant time. ifindex is the
+      interface the mapping was learned on, or -1 to keep the one already
+      recorded. The entry's handle and the cache generation it is good
+      for are stored in *handle and *gen, as sr_arpcache_lookup() would
+      return them. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip);
-
-/* Frees all memory associated with this arp request entry. If this arp request
-   entry is on the arp request queue, it is removed from the queue. */
+                                     uint32_t ip,
+                                     int ifindex,
+                                     int *handle,
+                                     unsigned int *gen);
+
+/* Removes this arp request entry from the queue without freeing it. The
+   caller must hold the cache lock. */
+void sr_arpreq_unlink(struct sr_arpcache *cache, struct sr_arpreq *entry);
+
+/* Hands this arp request entry and its packet slots back to their pools. If
+   this arp request entry is on the arp request queue, it is removed from the
+   queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 
 /* Prints out the ARP table. */
@@ -142,11 +234,15 @@ void sr_arpcache_dump(struct sr_arpcache *cache);
 
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
-   a destructor, and a cleanup thread times out cache entries every 15
-   seconds. */
+   a destructor, and a cache thread runs the timers that expire entries and
+   retry requests. size is the number of entries the cache can hold.
+   sr_arpcache_stop() ends the cache thread and waits for it, so the
+   frames it sends and the queues it flushes can be torn down; it must
+   come before everything else in the router's teardown. */
 
-int   sr_arpcache_init(struct sr_arpcache *cache);
+int   sr_arpcache_init(struct sr_arpcache *cache, unsigned int size);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
+void  sr_arpcache_stop(struct sr_arpcache *cache);
 
 #endif
@@ -0,0 +1,188 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_busypoll.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Busy polling backoff and latency histogram.  See sr_busypoll.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <sys/prctl.h>
+#endif
+
+#include "sr_busypoll.h"
+
+void sr_busypoll_init(struct sr_busypoll* bp, unsigned int idle_us)
+{
+    memset(bp, 0, sizeof(*bp));
+    bp->idle_us = idle_us;
+    bp->burst = 1;
+#ifdef _LINUX_
+    /* -- the default 50 us of timer slack would swamp the short sleeps -- */
+    if(idle_us)
+    { prctl(PR_SET_TIMERSLACK, 1000UL, 0, 0, 0); }
+#endif
+} /* -- sr_busypoll_init -- */
+
+int sr_busypoll_pin(int cpu)
+{
+#ifdef _LINUX_
+    cpu_set_t set;
+    int err;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if((err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+    {
+        fprintf(stderr, "Error: cannot pin to cpu %d: %s\n", cpu, strerror(err));
+        return -1;
+    }
+    return 0;
+#else
+    fprintf(stderr, "Error: cpu affinity needs Linux\n");
+    return -1;
+#endif
+} /* -- sr_busypoll_pin -- */
+
+uint64_t sr_busypoll_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} /* -- sr_busypoll_now -- */
+
+uint64_t sr_busypoll_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} /* -- sr_busypoll_wall -- */
+
+uint64_t sr_busypoll_age(uint64_t stamp, uint64_t wall)
+{ return wall > stamp ? wall - stamp : 0; }
+
+static void sr_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    __sync_synchronize();
+#endif
+} /* -- sr_cpu_relax -- */
+
+void sr_busypoll_idle(struct sr_busypoll* bp)
+{
+    uint64_t now = sr_busypoll_now();
+    uint64_t idle;
+    unsigned int i;
+
+    if(bp->idle_since == 0)
+    { bp->idle_since = now; }
+    idle = (now - bp->idle_since) / 1000;
+
+    if(idle < bp->idle_us)
+    {
+        bp->spins++;
+        return;
+    }
+
+    if(idle < 2 * (uint64_t)bp->idle_us)
+    {
+        for(i = 0; i < bp->burst; i++)
+        { sr_cpu_relax(); }
+        if(bp->burst < SR_BUSYPOLL_PAUSE_MAX)
+        { bp->burst *= 2; }
+        bp->pauses++;
+        return;
+    }
+
+    {
+        struct timespec ts;
+
+        ts.tv_sec = 0;
+        ts.tv_nsec = SR_BUSYPOLL_SLEEP_US * 1000;
+        nanosleep(&ts, 0);
+        bp->sleeps++;
+        bp->slept = 1;
+    }
+} /* -- sr_busypoll_idle -- */
+
+void sr_busypoll_work(struct sr_busypoll* bp)
+{
+    if(bp->idle_since && !bp->slept)
+    { bp->avoided++; }
+    bp->idle_since = 0;
+    bp->burst = 1;
+    bp->slept = 0;
+} /* -- sr_busypoll_work -- */
+
+/* 16 exact buckets, then 16 per power of two */
+static unsigned int sr_lat_bucket(uint64_t ns)
+{
+    unsigned int b, i;
+
+    if(ns < 16)
+    { return ns; }
+    b = 63 - __builtin_clzll(ns);
+    i = (b - 3) * 16 + ((ns >> (b - 4)) & 15);
+    return i < SR_LAT_BUCKETS ? i : SR_LAT_BUCKETS - 1;
+} /* -- sr_lat_bucket -- */
+
+static uint64_t sr_lat_value(unsigned int i)
+{
+    if(i < 16)
+    { return i; }
+    return (uint64_t)(16 + i % 16) << (i / 16 - 1);
+} /* -- sr_lat_value -- */
+
+void sr_lat_add(struct sr_lat* lat, uint64_t ns, unsigned int n)
+{
+    lat->count[sr_lat_bucket(ns)] += n;
+    lat->total += n;
+} /* -- sr_lat_add -- */
+
+uint64_t sr_lat_pct(const struct sr_lat* lat, double p)
+{
+    unsigned long want = (unsigned long)(p * lat->total);
+    unsigned long seen = 0;
+    unsigned int i;
+
+    for(i = 0; i < SR_LAT_BUCKETS; i++)
+    {
+        seen += lat->count[i];
+        if(seen > want)
+        { return sr_lat_value(i); }
+    }
+    return 0;
+} /* -- sr_lat_pct -- */
+
+void sr_busypoll_dump_stats(const struct sr_busypoll* bp)
+{
+    if(bp->idle_us)
+    {
+        fprintf(stderr, "busy poll (idle after %u us):\n", bp->idle_us);
+        fprintf(stderr, "  %lu spins, %lu pauses, %lu sleeps, %lu wakeups avoided\n",
+                bp->spins, bp->pauses, bp->sleeps, bp->avoided);
+    }
+    else
+    {
+        fprintf(stderr, "blocking reads:\n");
+        fprintf(stderr, "  %lu wakeups\n", bp->wakeups);
+    }
+    fprintf(stderr, "forwarding latency:\n");
+    fprintf(stderr, "  p50 %.1f us, p99 %.1f us over %lu frames\n",
+            sr_lat_pct(&(bp->lat), 0.50) / 1000.0,
+            sr_lat_pct(&(bp->lat), 0.99) / 1000.0, bp->lat.total);
+} /* -- sr_busypoll_dump_stats -- */
@@ -0,0 +1,236 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Control thread taking ARP, ICMP and for-me traffic off the forwarding
+ * path.  See sr_ctl.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <assert.h>
+
+#include "sr_ctl.h"
+#include "sr_router.h"
+#include "sr_worker.h"
+#include "sr_afpacket.h"
+
+/* the calling thread's queue of class cls: the reader's come first */
+static struct sr_ctl_queue* sr_ctl_queue_self(struct sr_ctl* ctl, unsigned int cls)
+{
+    struct sr_worker* w = sr_worker_self();
+
+    return &(ctl->q[(w ? w->id + 1 : 0) * SR_CTL_CLASSES + cls]);
+} /* -- sr_ctl_queue_self -- */
+
+int sr_ctl_punt(struct sr_instance* sr, unsigned int cls,
+                const uint8_t* frame, unsigned int len,
+                struct sr_if* iface, unsigned int tag)
+{
+    struct sr_ctl_queue* q = sr_ctl_queue_self(sr->ctl, cls);
+    uint8_t* buf;
+
+    /* -- under a flood the frame is dropped before it costs a copy -- */
+    if(sr_ring_room(&(q->ring)) == 0 || (buf = sr_packet_alloc(len)) == 0)
+    {
+        q->drops++;
+        return -1;
+    }
+    memcpy(buf, frame, len);
+    sr_ring_push(&(q->ring), buf, len, iface, 0, tag);
+    q->punted++;
+    return 0;
+} /* -- sr_ctl_punt -- */
+
+void sr_ctl_kick(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = sr->ctl;
+    int published = 0;
+    unsigned int c;
+
+    for(c = 0; c < SR_CTL_CLASSES; c++)
+    { published |= sr_ring_publish(&(sr_ctl_queue_self(ctl, c)->ring)); }
+    if(published)
+    { sr_bell_ring(&(ctl->bell)); }
+} /* -- sr_ctl_kick -- */
+
+/* handles up to SR_CTL_BATCH frames of q; returns how many */
+static unsigned int sr_ctl_run(struct sr_ctl* ctl, struct sr_ctl_queue* q,
+                               unsigned int cls)
+{
+    struct sr_ring_slot* s;
+    unsigned int n, i;
+
+    n = sr_ring_avail(&(q->ring));
+    if(n > SR_CTL_BATCH)
+    { n = SR_CTL_BATCH; }
+    for(i = 0; i < n; i++)
+    {
+        s = sr_ring_peek(&(q->ring), i);
+        sr_handle_control(ctl->sr, cls, s->frame, s->len, s->iface, s->tag);
+        sr_packet_free(s->frame);
+    }
+    sr_ring_pop(&(q->ring), n);
+    ctl->handled[cls] += n;
+    return n;
+} /* -- sr_ctl_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_main(..)
+ * Scope:  Local
+ *
+ * Takes a batch off every ARP queue, then off every IP queue, so ARP
+ * keeps moving while pings pile up, and flushes what it sent.  Sleeps
+ * on its bell once all queues are empty.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_ctl_main(void* arg)
+{
+    struct sr_ctl* ctl = (struct sr_ctl*)arg;
+    struct sr_instance* sr = ctl->sr;
+    unsigned int i, c, done, seq;
+
+    while(!ctl->stop)
+    {
+        done = 0;
+        for(c = 0; c < SR_CTL_CLASSES; c++)
+        {
+            for(i = 0; i < ctl->nq; i++)
+            { done += sr_ctl_run(ctl, &(ctl->q[i * SR_CTL_CLASSES + c]), c); }
+        }
+
+        if(done)
+        {
+            if(sr->afp)
+            { sr_afpacket_flush(sr->afp); }
+            else
+            { sr_tx_flush(&(sr->tx)); }
+            continue;
+        }
+
+        seq = sr_bell_arm(&(ctl->bell));
+        for(i = 0; i < ctl->nq * SR_CTL_CLASSES; i++)
+        {
+            if(sr_ring_avail(&(ctl->q[i].ring)))
+            { break; }
+        }
+        if(i == ctl->nq * SR_CTL_CLASSES && !ctl->stop)
+        { sr_bell_wait(&(ctl->bell), seq); }
+        else
+        { sr_bell_disarm(&(ctl->bell)); }
+    }
+    return 0;
+} /* -- sr_ctl_main -- */
+
+int sr_ctl_start(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl;
+    sigset_t all, old;
+    unsigned int i;
+    int err;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if((ctl = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_ctl_start)\n");
+        return -1;
+    }
+    ctl->sr = sr;
+    ctl->nq = 1 + (sr->workers ? sr->workers->num : 0);
+    if((ctl->q = (struct sr_ctl_queue*)calloc(ctl->nq * SR_CTL_CLASSES,
+                                              sizeof(struct sr_ctl_queue))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_ctl_start)\n");
+        free(ctl);
+        return -1;
+    }
+    for(i = 0; i < ctl->nq * SR_CTL_CLASSES; i++)
+    { sr_ring_init(&(ctl->q[i].ring)); }
+    sr->ctl = ctl;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    err = pthread_create(&(ctl->thread), 0, sr_ctl_main, ctl);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    if(err != 0)
+    {
+        fprintf(stderr, "Error: cannot start the control thread: %s\n", strerror(err));
+        sr->ctl = 0;
+        free(ctl->q);
+        free(ctl);
+        return -1;
+    }
+    printf("ARP, ICMP and local traffic on a control thread\n");
+    return 0;
+} /* -- sr_ctl_start -- */
+
+void sr_ctl_stop(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = sr->ctl;
+    struct sr_ring* r;
+    unsigned int i, n;
+
+    if(!ctl || ctl->stop)
+    { return; }
+
+    ctl->stop = 1;
+    sr_bell_ring(&(ctl->bell));
+    pthread_join(ctl->thread, 0);
+
+    /* -- frames nobody will answer any more -- */
+    for(i = 0; i < ctl->nq * SR_CTL_CLASSES; i++)
+    {
+        r = &(ctl->q[i].ring);
+        for(n = sr_ring_avail(r); n > 0; n--)
+        {
+            sr_packet_free(sr_ring_peek(r, 0)->frame);
+            sr_ring_pop(r, 1);
+        }
+    }
+} /* -- sr_ctl_stop -- */
+
+void sr_ctl_destroy(struct sr_instance* sr)
+{
+    if(!sr->ctl)
+    { return; }
+    sr_ctl_stop(sr);
+    free(sr->ctl->q);
+    free(sr->ctl);
+    sr->ctl = 0;
+} /* -- sr_ctl_destroy -- */
+
+void sr_ctl_dump_stats(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = sr->ctl;
+    struct sr_ctl_queue* arp;
+    struct sr_ctl_queue* ip;
+    char who[16];
+    unsigned int i;
+
+    fprintf(stderr, "control thread:\n");
+    fprintf(stderr, "  handled %lu ARP, %lu IP, %lu sleeps, %lu wakes\n",
+            ctl->handled[SR_CTL_ARP], ctl->handled[SR_CTL_IP],
+            ctl->bell.waits, ctl->bell.rings);
+    for(i = 0; i < ctl->nq; i++)
+    {
+        arp = &(ctl->q[i * SR_CTL_CLASSES + SR_CTL_ARP]);
+        ip = &(ctl->q[i * SR_CTL_CLASSES + SR_CTL_IP]);
+        if(i)
+        { snprintf(who, sizeof(who), "worker %u", i - 1); }
+        else
+        { strcpy(who, "reader"); }
+        fprintf(stderr, "  %s: ARP queued %lu, max depth %u, dropped %lu; "
+                "IP queued %lu, max depth %u, dropped %lu\n", who,
+                arp->punted, arp->ring.max_depth, arp->drops,
+                ip->punted, ip->ring.max_depth, ip->drops);
+    }
+} /* -- sr_ctl_dump_stats -- */
@@ -0,0 +1,91 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Slow path.  With -S the thread forwarding a frame (the reader, or a
+ * worker with -w) only runs the IPv4 transit path itself; everything
+ * that needs an answer from the router is copied onto a queue and
+ * handled by a control thread:
+ *
+ *   SR_CTL_ARP  ARP requests for our addresses
+ *   SR_CTL_IP   IP for the router (ping, port unreachable) and transit
+ *               frames to answer with an ICMP error, their type and
+ *               code in the slot's tag
+ *
+ * ARP replies stay on the fast path: they release the frames queued
+ * for the sender in order, and the next transit frame may need them.
+ *
+ * Every forwarding thread has a pair of queues of its own, sr_rings of
+ * SR_RING_SIZE frames, so the fast path takes no lock.  A full queue
+ * drops the frame before it is copied and counts it: a flood of pings
+ * fills the IP queue without touching ARP or transit traffic.  The
+ * control thread empties the ARP queues first.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_ring.h"
+
+#define SR_CTL_ARP      0
+#define SR_CTL_IP       1
+#define SR_CTL_CLASSES  2
+
+#define SR_CTL_LOCAL             0   /* tag of a frame for the router */
+#define SR_CTL_ICMP(type, code)  (0x10000 | ((type) << 8) | (code))
+
+#define SR_CTL_BATCH    32           /* frames per queue and pass */
+
+struct sr_instance;
+struct sr_if;
+
+struct sr_ctl_queue
+{
+    struct sr_ring ring;
+    unsigned long punted;       /* frames queued */
+    unsigned long drops;        /* queue full, or no buffer */
+};
+
+struct sr_ctl
+{
+    struct sr_instance* sr;
+    pthread_t thread;
+    struct sr_bell bell;        /* the control thread sleeps on the queues */
+    volatile int stop;
+    struct sr_ctl_queue* q;     /* SR_CTL_CLASSES per forwarding thread */
+    unsigned int nq;
+    unsigned long handled[SR_CTL_CLASSES];
+};
+
+/* Starts the control thread, after the workers if there are any.
+   Returns 0 or -1. */
+int  sr_ctl_start(struct sr_instance* sr);
+void sr_ctl_stop(struct sr_instance* sr);
+void sr_ctl_destroy(struct sr_instance* sr);
+
+/* Copies frame onto the calling thread's queue of class cls.  Returns 0,
+   or -1 if it was dropped.  The caller keeps frame either way. */
+int  sr_ctl_punt(struct sr_instance* sr, unsigned int cls,
+                 const uint8_t* frame, unsigned int len,
+                 struct sr_if* iface, unsigned int tag);
+
+/* Makes the calling thread's punted frames visible and wakes the
+   control thread; once per burst. */
+void sr_ctl_kick(struct sr_instance* sr);
+
+void sr_ctl_dump_stats(struct sr_instance* sr);
+
+#endif /* -- SR_CTL_H -- */
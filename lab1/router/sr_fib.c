@@ -0,0 +1,386 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * DIR-24-8 longest prefix match table compiled from the routing table.
+ *
+ * Matching rules are the ones the routing table walk always used:
+ *  - the prefix length of a route is the number of leading one bits in
+ *    its mask and only those bits of dest are compared
+ *  - on equal prefix lengths the route listed first wins
+ *  - when nothing matches, the last 0.0.0.0/0.0.0.0 route is used
+ *  - any other route without leading mask bits never matches
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+struct sr_fib_prefix
+{
+    uint32_t prefix;     /* host byte order, masked */
+    int plen;
+    int order;           /* position in the routing table list */
+    struct sr_rt* rt;
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_prefix_cmp(..)
+ * Scope:  Local
+ *
+ * Shorter prefixes first so longer ones overwrite them.  Equal lengths
+ * are ordered last-listed first so the first listed route is written
+ * last and wins.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_prefix_cmp(const void* a, const void* b)
+{
+    const struct sr_fib_prefix* pa = (const struct sr_fib_prefix*)a;
+    const struct sr_fib_prefix* pb = (const struct sr_fib_prefix*)b;
+
+    if(pa->plen != pb->plen)
+    { return pa->plen - pb->plen; }
+    return pb->order - pa->order;
+} /* -- sr_fib_prefix_cmp -- */
+
+static int sr_fib_mask_len(uint32_t mask)
+{
+    int plen = 0;
+    while(plen < 32 && (mask & (0x80000000 >> plen)))
+    { plen++; }
+    return plen;
+} /* -- sr_fib_mask_len -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_tbl8_alloc(..)
+ * Scope:  Local
+ *
+ * Grab a new tbl8 group pre-filled with the covering tbl24 value.
+ * Returns the group index or -1 when out of memory / group space.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_tbl8_alloc(struct sr_fib* fib, uint32_t fill)
+{
+    uint32_t* group;
+    int i;
+
+    if(fib->tbl8_groups == fib->tbl8_cap)
+    {
+        unsigned int cap = fib->tbl8_cap ? fib->tbl8_cap * 2 : 16;
+        uint32_t* tbl8;
+
+        if(cap > SR_FIB_TBL8_MAX)
+        { return -1; }
+        tbl8 = (uint32_t*)realloc(fib->tbl8,
+                cap * SR_FIB_TBL8_SIZE * sizeof(uint32_t));
+        if(!tbl8)
+        { return -1; }
+        fib->tbl8 = tbl8;
+        fib->tbl8_cap = cap;
+    }
+
+    group = fib->tbl8 + fib->tbl8_groups * SR_FIB_TBL8_SIZE;
+    for(i = 0; i < SR_FIB_TBL8_SIZE; i++)
+    { group[i] = fill; }
+
+    return fib->tbl8_groups++;
+} /* -- sr_fib_tbl8_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert(..)
+ * Scope:  Local
+ *
+ * Write one prefix into the tables.  Must be called in ascending
+ * prefix length order.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_insert(struct sr_fib* fib, uint32_t prefix, int plen,
+                         uint32_t value)
+{
+    uint32_t idx, count, i;
+
+    if(plen <= 24)
+    {
+        idx = prefix >> 8;
+        count = 1u << (24 - plen);
+        for(i = 0; i < count; i++)
+        { fib->tbl24[idx + i] = value; }
+        return 0;
+    }
+
+    idx = prefix >> 8;
+    if(!(fib->tbl24[idx] & SR_FIB_EXT_FLAG))
+    {
+        int group = sr_fib_tbl8_alloc(fib, fib->tbl24[idx]);
+        if(group < 0)
+        { return -1; }
+        fib->tbl24[idx] = SR_FIB_EXT_FLAG | (uint32_t)group;
+    }
+
+    idx = ((fib->tbl24[idx] & ~SR_FIB_EXT_FLAG) * SR_FIB_TBL8_SIZE) +
+          (prefix & 0xff);
+    count = 1u << (32 - plen);
+    for(i = 0; i < count; i++)
+    { fib->tbl8[idx + i] = value; }
+
+    return 0;
+} /* -- sr_fib_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_bind_adjs(..)
+ * Scope:  Local
+ *
+ * Create the adjacencies for every route the fib can return and point
+ * the routes at them.  Pointers are only taken once the table has
+ * stopped growing.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_bind_adjs(struct sr_fib* fib, struct sr_fib_prefix* prefixes,
+                            int num_prefixes)
+{
+    int* adjidx;
+    int default_idx = -1;
+    int i;
+
+    adjidx = (int*)malloc((num_prefixes + 1) * sizeof(int));
+    if(!adjidx)
+    { return -1; }
+
+    for(i = 0; i < num_prefixes; i++)
+    {
+        adjidx[i] = sr_adjtab_add(&fib->adjtab, prefixes[i].rt->gw.s_addr,
+                                  prefixes[i].rt->interface);
+        if(adjidx[i] < 0)
+        { goto fail; }
+    }
+    if(fib->default_rt)
+    {
+        default_idx = sr_adjtab_add(&fib->adjtab, fib->default_rt->gw.s_addr,
+                                    fib->default_rt->interface);
+        if(default_idx < 0)
+        { goto fail; }
+    }
+
+    for(i = 0; i < num_prefixes; i++)
+    { prefixes[i].rt->adj = &fib->adjtab.adjs[adjidx[i]]; }
+    if(fib->default_rt)
+    { fib->default_rt->adj = &fib->adjtab.adjs[default_idx]; }
+
+    free(adjidx);
+    return 0;
+
+fail:
+    free(adjidx);
+    return -1;
+} /* -- sr_fib_bind_adjs -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build(..)
+ * Scope:  Global
+ *
+ * Compile the routing table list into a new fib.  Returns 0 if memory
+ * could not be allocated.  The fib borrows the sr_rt entries, so it has
+ * to be destroyed before the routing table is.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_build(struct sr_rt* table)
+{
+    struct sr_fib* fib = 0;
+    struct sr_fib_prefix* prefixes = 0;
+    struct sr_rt* rt_walker = 0;
+    int num_routes = 0;
+    int num_prefixes = 0;
+    int i;
+
+    fib = (struct sr_fib*)calloc(1, sizeof(struct sr_fib));
+    if(!fib)
+    { return 0; }
+
+    fib->tbl24 = (uint32_t*)calloc(SR_FIB_TBL24_SIZE, sizeof(uint32_t));
+    if(!fib->tbl24)
+    { goto fail; }
+
+    for(rt_walker = table; rt_walker; rt_walker = rt_walker->next)
+    { num_routes++; }
+
+    prefixes = (struct sr_fib_prefix*)malloc((num_routes + 1) *
+                                              sizeof(struct sr_fib_prefix));
+    fib->nexthops = (struct sr_rt**)malloc((num_routes + 1) *
+                                           sizeof(struct sr_rt*));
+    if(!prefixes || !fib->nexthops)
+    { goto fail; }
+
+    for(rt_walker = table, i = 0; rt_walker; rt_walker = rt_walker->next, i++)
+    {
+        uint32_t mask = ntohl(rt_walker->mask.s_addr);
+        int plen = sr_fib_mask_len(mask);
+
+        if(rt_walker->dest.s_addr == 0 && rt_walker->mask.s_addr == 0)
+        {
+            fib->default_rt = rt_walker;
+            continue;
+        }
+        if(plen == 0)
+        { continue; }
+
+        prefixes[num_prefixes].prefix = ntohl(rt_walker->dest.s_addr) &
+                                        (0xffffffff << (32 - plen));
+        prefixes[num_prefixes].plen = plen;
+        prefixes[num_prefixes].order = i;
+        prefixes[num_prefixes].rt = rt_walker;
+        num_prefixes++;
+    }
+
+    if(sr_fib_bind_adjs(fib, prefixes, num_prefixes) != 0)
+    { goto fail; }
+
+    qsort(prefixes, num_prefixes, sizeof(struct sr_fib_prefix),
+          sr_fib_prefix_cmp);
+
+    for(i = 0; i < num_prefixes; i++)
+    { fib->nexthops[i] = prefixes[i].rt; }
+    fib->num_nexthops = num_prefixes;
+
+    for(i = 0; i < num_prefixes; i++)
+    {
+        if(sr_fib_insert(fib, prefixes[i].prefix, prefixes[i].plen,
+                         (uint32_t)(i + 1)) != 0)
+        { goto fail; }
+    }
+
+    free(prefixes);
+    return fib;
+
+fail:
+    fprintf(stderr, "Error: out of memory building forwarding table\n");
+    free(prefixes);
+    sr_fib_destroy(fib);
+    return 0;
+} /* -- sr_fib_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_destroy(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_destroy(struct sr_fib* fib)
+{
+    unsigned int i;
+
+    if(!fib)
+    { return; }
+
+    /* -- the routes may outlive their adjacencies -- */
+    for(i = 0; i < fib->num_nexthops; i++)
+    { fib->nexthops[i]->adj = 0; }
+    if(fib->default_rt)
+    { fib->default_rt->adj = 0; }
+    sr_adjtab_destroy(&fib->adjtab);
+
+    free(fib->tbl24);
+    free(fib->tbl8);
+    free(fib->nexthops);
+    free(fib);
+} /* -- sr_fib_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup(..)
+ * Scope:  Global
+ *
+ * Longest prefix match for a destination in network byte order.
+ * Returns the matching route, the default route or 0.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip_nbo)
+{
+    uint32_t ip = ntohl(ip_nbo);
+    uint32_t entry;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+
+    entry = fib->tbl24[ip >> 8];
+    if(entry & SR_FIB_EXT_FLAG)
+    {
+        entry = fib->tbl8[((entry & ~SR_FIB_EXT_FLAG) * SR_FIB_TBL8_SIZE) +
+                          (ip & 0xff)];
+    }
+
+    if(entry)
+    { return fib->nexthops[entry - 1]; }
+    return fib->default_rt;
+} /* -- sr_fib_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup_bulk(..)
+ * Scope:  Global
+ *
+ * Resolve n destinations (network byte order) into rts[0..n-1] with
+ * the same result sr_fib_lookup() would give for each.  Work is done in
+ * batches of SR_FIB_BULK_MAX: every tbl24 line of a batch is prefetched
+ * before any is read, then every tbl8 line that is needed, so the cache
+ * misses of a batch overlap instead of being paid one after another.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_lookup_bulk(const struct sr_fib* fib, const uint32_t* ip_nbo,
+                        struct sr_rt** rts, unsigned int n)
+{
+    uint32_t ip[SR_FIB_BULK_MAX];
+    uint32_t entry[SR_FIB_BULK_MAX];
+    unsigned int batch, i;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+
+    while(n > 0)
+    {
+        batch = (n < SR_FIB_BULK_MAX) ? n : SR_FIB_BULK_MAX;
+
+        for(i = 0; i < batch; i++)
+        {
+            ip[i] = ntohl(ip_nbo[i]);
+            __builtin_prefetch(&fib->tbl24[ip[i] >> 8]);
+        }
+
+        for(i = 0; i < batch; i++)
+        {
+            entry[i] = fib->tbl24[ip[i] >> 8];
+            if(entry[i] & SR_FIB_EXT_FLAG)
+            {
+                entry[i] = ((entry[i] & ~SR_FIB_EXT_FLAG) * SR_FIB_TBL8_SIZE) +
+                           (ip[i] & 0xff);
+                __builtin_prefetch(&fib->tbl8[entry[i]]);
+                entry[i] |= SR_FIB_EXT_FLAG;
+            }
+        }
+
+        for(i = 0; i < batch; i++)
+        {
+            uint32_t e = entry[i];
+            if(e & SR_FIB_EXT_FLAG)
+            { e = fib->tbl8[e & ~SR_FIB_EXT_FLAG]; }
+            rts[i] = e ? fib->nexthops[e - 1] : fib->default_rt;
+        }
+
+        ip_nbo += batch;
+        rts += batch;
+        n -= batch;
+    }
+} /* -- sr_fib_lookup_bulk -- */
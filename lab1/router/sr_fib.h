@@ -0,0 +1,62 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Compiled forwarding table built from the sr_rt list.  Lookups use a
+ * DIR-24-8 layout: the top 24 bits of the destination index tbl24 and
+ * prefixes longer than /24 spill into 256-entry tbl8 groups, so every
+ * lookup costs one or two memory accesses regardless of table size.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_adj.h"
+
+struct sr_rt;
+
+#define SR_FIB_TBL24_SIZE  (1 << 24)
+#define SR_FIB_TBL8_SIZE   256
+#define SR_FIB_TBL8_MAX    (1 << 16)  /* /24s that hold longer prefixes */
+#define SR_FIB_EXT_FLAG    0x80000000 /* tbl24 entry refers to a tbl8 group */
+#define SR_FIB_BULK_MAX    32         /* lookups interleaved per batch */
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib
+ *
+ * A zero entry means "no prefix matched", anything else (without the
+ * extension flag) is an index + 1 into nexthops.  Every route the fib
+ * can return has rt->adj pointing into adjtab.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib
+{
+    uint32_t* tbl24;
+    uint32_t* tbl8;
+    unsigned int tbl8_groups;   /* groups in use */
+    unsigned int tbl8_cap;      /* groups allocated */
+    struct sr_rt** nexthops;
+    unsigned int num_nexthops;
+    struct sr_rt* default_rt;   /* 0.0.0.0/0.0.0.0 entry, if any */
+    struct sr_adjtab adjtab;    /* next hops of the routes above */
+};
+
+struct sr_fib* sr_fib_build(struct sr_rt* table);
+void sr_fib_destroy(struct sr_fib* fib);
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip_nbo);
+void sr_fib_lookup_bulk(const struct sr_fib* fib, const uint32_t* ip_nbo,
+                        struct sr_rt** rts, unsigned int n);
+
+#endif /* -- SR_FIB_H -- */
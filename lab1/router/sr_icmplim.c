@@ -0,0 +1,159 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplim.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Rate limits for generated ICMP errors.  See sr_icmplim.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_icmplim.h"
+
+void sr_icmplim_init(struct sr_icmplim* lim)
+{
+    memset(lim, 0, sizeof(*lim));
+    lim->mask = SR_ICMPLIM_MASK;
+    lim->dest_cost = SR_ICMPLIM_DEST_MS * 1000000ULL;
+    lim->type_cost = 1000000000ULL / SR_ICMPLIM_TYPE_PPS;
+    pthread_mutex_init(&(lim->lock), 0);
+} /* -- sr_icmplim_init -- */
+
+void sr_icmplim_destroy(struct sr_icmplim* lim)
+{
+    pthread_mutex_destroy(&(lim->lock));
+} /* -- sr_icmplim_destroy -- */
+
+int sr_icmplim_config(struct sr_icmplim* lim, const char* spec)
+{
+    unsigned long dest_ms;
+    unsigned long type_pps = SR_ICMPLIM_TYPE_PPS;
+    unsigned long mask = SR_ICMPLIM_MASK;
+    char* end;
+
+    dest_ms = strtoul(spec, &end, 10);
+    if(end == spec)
+    { return -1; }
+    if(*end == ',')
+    {
+        spec = end + 1;
+        type_pps = strtoul(spec, &end, 10);
+        if(end == spec)
+        { return -1; }
+    }
+    if(*end == ',')
+    {
+        spec = end + 1;
+        mask = strtoul(spec, &end, 0);
+        if(end == spec)
+        { return -1; }
+    }
+    if(*end != '\0')
+    { return -1; }
+
+    lim->mask = (uint32_t)mask;
+    lim->dest_cost = dest_ms * 1000000ULL;
+    lim->type_cost = type_pps ? 1000000000ULL / type_pps : 0;
+    return 0;
+} /* -- sr_icmplim_config -- */
+
+/* brings b's credit up to now, a bucket never used starts full */
+static uint64_t sr_icmplim_refill(struct sr_icmplim_bucket* b, uint64_t now,
+                                  uint64_t cost, unsigned int burst)
+{
+    uint64_t cap = cost * burst;
+
+    if(b->last == 0)
+    { b->credit = cap; }
+    else
+    {
+        b->credit += now - b->last;
+        if(b->credit > cap)
+        { b->credit = cap; }
+    }
+    b->last = now;
+    return b->credit;
+} /* -- sr_icmplim_refill -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_icmplim_allow(..)
+ * Scope:  Global
+ *
+ * Refills the type's and the destination's bucket and takes a token
+ * from each only if both have one, so a message one of them refuses
+ * costs the other nothing.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_icmplim_allow(struct sr_icmplim* lim, uint8_t type, uint32_t dst)
+{
+    struct sr_icmplim_bucket* tb = 0;
+    struct sr_icmplim_bucket* db = 0;
+    struct timespec ts;
+    uint64_t now;
+    int ok = 1;
+
+    if(type >= SR_ICMPLIM_TYPES || !(lim->mask & (1u << type)))
+    { return 1; }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    pthread_mutex_lock(&(lim->lock));
+
+    if(lim->type_cost)
+    {
+        tb = &(lim->types[type]);
+        if(sr_icmplim_refill(tb, now, lim->type_cost, SR_ICMPLIM_TYPE_BURST) < lim->type_cost)
+        {
+            lim->by_type[type]++;
+            ok = 0;
+        }
+    }
+    if(ok && lim->dest_cost)
+    {
+        db = &(lim->dests[((dst * 2654435761u) >> 24) & (SR_ICMPLIM_DESTS - 1)]);
+        if(db->ip != dst)
+        {
+            db->ip = dst;
+            db->last = 0;
+        }
+        if(sr_icmplim_refill(db, now, lim->dest_cost, SR_ICMPLIM_DEST_BURST) < lim->dest_cost)
+        {
+            lim->by_dest[type]++;
+            ok = 0;
+        }
+    }
+    if(ok)
+    {
+        if(tb)
+        { tb->credit -= lim->type_cost; }
+        if(db)
+        { db->credit -= lim->dest_cost; }
+        lim->sent++;
+    }
+
+    pthread_mutex_unlock(&(lim->lock));
+    return ok;
+} /* -- sr_icmplim_allow -- */
+
+void sr_icmplim_dump_stats(struct sr_icmplim* lim)
+{
+    unsigned int t;
+
+    fprintf(stderr, "ICMP rate limit (mask 0x%x):\n", lim->mask);
+    fprintf(stderr, "  %lu sent\n", lim->sent);
+    for(t = 0; t < SR_ICMPLIM_TYPES; t++)
+    {
+        if(lim->by_type[t] || lim->by_dest[t])
+        {
+            fprintf(stderr, "  type %u: suppressed %lu by type, %lu by destination\n",
+                    t, lim->by_type[t], lim->by_dest[t]);
+        }
+    }
+} /* -- sr_icmplim_dump_stats -- */
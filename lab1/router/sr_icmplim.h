@@ -0,0 +1,82 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmplim.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Token buckets limiting the ICMP errors the router generates, after
+ * Linux's icmp_ratelimit, icmp_ratemask and icmp_msgs_per_sec.  A type
+ * whose bit is set in mask is sent only if both of these have a token:
+ *
+ *   - the bucket of its type, refilled at type_pps messages a second
+ *     and holding up to SR_ICMPLIM_TYPE_BURST of them;
+ *   - the bucket of its destination, refilled one message every dest_ms
+ *     and holding up to SR_ICMPLIM_DEST_BURST.
+ *
+ * Destinations share SR_ICMPLIM_DESTS buckets by hash; a new destination
+ * takes its slot over with a full bucket.  A bucket keeps its tokens as
+ * credit in nanoseconds, the time it has saved up, so refilling is one
+ * subtraction.  generateICMP() asks before allocating anything;
+ * suppressed messages are counted per type.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ICMPLIM_H
+#define SR_ICMPLIM_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_ICMPLIM_TYPES        32
+#define SR_ICMPLIM_DESTS        256     /* power of two */
+#define SR_ICMPLIM_TYPE_BURST   50
+#define SR_ICMPLIM_DEST_BURST   6
+
+/* Linux's defaults: one message a second per destination, 1000 a second
+   per type, for destination unreachable, source quench, time exceeded
+   and parameter problem. */
+#define SR_ICMPLIM_DEST_MS      1000
+#define SR_ICMPLIM_TYPE_PPS     1000
+#define SR_ICMPLIM_MASK         0x1818
+
+struct sr_icmplim_bucket
+{
+    uint32_t ip;                /* destination, 0 for a type bucket */
+    uint64_t last;              /* ns, when credit was last brought up */
+    uint64_t credit;            /* ns saved up, one message per cost */
+};
+
+struct sr_icmplim
+{
+    uint32_t mask;              /* types limited, bit per type */
+    uint64_t dest_cost;         /* ns per message and destination, 0 off */
+    uint64_t type_cost;         /* ns per message and type, 0 off */
+    struct sr_icmplim_bucket types[SR_ICMPLIM_TYPES];
+    struct sr_icmplim_bucket dests[SR_ICMPLIM_DESTS];
+    unsigned long sent;                     /* messages allowed */
+    unsigned long by_type[SR_ICMPLIM_TYPES];  /* suppressed by the type bucket */
+    unsigned long by_dest[SR_ICMPLIM_TYPES];  /* suppressed by the destination's */
+    pthread_mutex_t lock;
+};
+
+void sr_icmplim_init(struct sr_icmplim* lim);
+void sr_icmplim_destroy(struct sr_icmplim* lim);
+
+/* Sets the limits from "dest_ms[,type_pps[,mask]]"; 0 turns a bucket
+   off.  Returns 0, or -1 if spec does not parse. */
+int  sr_icmplim_config(struct sr_icmplim* lim, const char* spec);
+
+/* Takes a token for a message of type to dst, network byte order.
+   Returns 1 if it may be sent. */
+int  sr_icmplim_allow(struct sr_icmplim* lim, uint8_t type, uint32_t dst);
+
+void sr_icmplim_dump_stats(struct sr_icmplim* lim);
+
+#endif /* -- SR_ICMPLIM_H -- */
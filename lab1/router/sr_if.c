@@ -24,6 +24,63 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_utils.h"
+
+static unsigned int sr_if_hash_name(const char* name)
+{
+    unsigned int h = 2166136261u;
+    int i;
+
+    for(i = 0; i < sr_IFACE_NAMELEN && name[i]; i++)
+    { h = (h ^ (unsigned char)name[i]) * 16777619u; }
+    return h;
+} /* -- sr_if_hash_name -- */
+
+static unsigned int sr_if_hash_ip(uint32_t ip)
+{ return (ip * 2654435761u) >> 16; }
+
+static unsigned int sr_if_hash_mac(const unsigned char* addr)
+{
+    uint32_t lo, hi = addr[4] << 8 | addr[5];
+
+    memcpy(&lo, addr, 4);
+    return ((lo ^ hi) * 2654435761u) >> 16;
+} /* -- sr_if_hash_mac -- */
+
+static void sr_if_hash_put(unsigned char* slots, unsigned int h,
+                           unsigned int index)
+{
+    while(slots[h & (SR_IF_HASH-1)])
+    { h++; }
+    slots[h & (SR_IF_HASH-1)] = index + 1;
+} /* -- sr_if_hash_put -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_rehash(..)
+ * Scope:  Local
+ *
+ * Rebuilds the three hashes from the table.  Interfaces only change
+ * while VNSHWINFO is processed, so rebuilding beats updating in place.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_if_rehash(struct sr_iftab* tab)
+{
+    unsigned int i;
+
+    memset(tab->by_name, 0, sizeof(tab->by_name));
+    memset(tab->by_ip, 0, sizeof(tab->by_ip));
+    memset(tab->by_mac, 0, sizeof(tab->by_mac));
+
+    for(i = 0; i < tab->num; i++)
+    {
+        struct sr_if* iface = tab->ifs[i];
+
+        sr_if_hash_put(tab->by_name, sr_if_hash_name(iface->name), i);
+        sr_if_hash_put(tab->by_ip, sr_if_hash_ip(iface->ip), i);
+        sr_if_hash_put(tab->by_mac, sr_if_hash_mac(iface->addr), i);
+    }
+} /* -- sr_if_rehash -- */
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
@@ -36,24 +93,62 @@
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
 {
-    struct sr_if* if_walker = 0;
+    struct sr_iftab* tab;
+    unsigned int h;
+    int slot;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
 
-    if_walker = sr->if_list;
-
-    while(if_walker)
+    tab = &(sr->iftab);
+    for(h = sr_if_hash_name(name); (slot = tab->by_name[h & (SR_IF_HASH-1)]); h++)
     {
-       if(!strncmp(if_walker->name,name,sr_IFACE_NAMELEN))
-        { return if_walker; }
-        if_walker = if_walker->next;
+        if(!strncmp(tab->ifs[slot-1]->name,name,sr_IFACE_NAMELEN))
+        { return tab->ifs[slot-1]; }
     }
 
     return 0;
 } /* -- sr_get_interface -- */
 
+struct sr_if* sr_get_interface_idx(struct sr_instance* sr, int index)
+{
+    if(index < 0 || index >= (int)sr->iftab.num)
+    { return 0; }
+    return sr->iftab.ifs[index];
+} /* -- sr_get_interface_idx -- */
+
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    struct sr_iftab* tab = &(sr->iftab);
+    unsigned int h;
+    int slot;
+
+    for(h = sr_if_hash_ip(ip_nbo); (slot = tab->by_ip[h & (SR_IF_HASH-1)]); h++)
+    {
+        if(tab->ifs[slot-1]->ip == ip_nbo)
+        { return tab->ifs[slot-1]; }
+    }
+
+    return 0;
+} /* -- sr_get_interface_by_ip -- */
+
+struct sr_if* sr_get_interface_by_mac(struct sr_instance* sr,
+                                      const unsigned char* addr)
+{
+    struct sr_iftab* tab = &(sr->iftab);
+    unsigned int h;
+    int slot;
+
+    for(h = sr_if_hash_mac(addr); (slot = tab->by_mac[h & (SR_IF_HASH-1)]); h++)
+    {
+        if(!memcmp(tab->ifs[slot-1]->addr, addr, ETHER_ADDR_LEN))
+        { return tab->ifs[slot-1]; }
+    }
+
+    return 0;
+} /* -- sr_get_interface_by_mac -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_destroy_interface(..)
  * Scope: Global
@@ -72,17 +167,20 @@ void sr_destroy_interface(struct sr_instance* sr)
 	 curr = curr->next;
          free(prev);
     }
+    sr->if_list = 0;
+    memset(&(sr->iftab), 0, sizeof(sr->iftab));
 }
 
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
  *
- * Add and interface to the router's list
+ * Add and interface to the router's list.  The count comes from the
+ * server, so one past SR_IF_MAX is refused: returns -1 and adds nothing.
  *
  *---------------------------------------------------------------------*/
 
-void sr_add_interface(struct sr_instance* sr, const char* name)
+int sr_add_interface(struct sr_instance* sr, const char* name)
 {
     struct sr_if* if_walker = 0;
 
@@ -90,14 +188,24 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     assert(name);
     assert(sr);
 
+    if(sr->iftab.num >= SR_IF_MAX)
+    {
+        fprintf(stderr, "sr_add_interface: more than %d interfaces, "
+                "ignoring %.*s\n", SR_IF_MAX, sr_IFACE_NAMELEN, name);
+        return -1;
+    }
+
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
-        sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
+        sr->if_list = (struct sr_if*)calloc(1, sizeof(struct sr_if));
         assert(sr->if_list);
         sr->if_list->next = 0;
+        sr->if_list->index = sr->iftab.num;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
-        return;
+        sr->iftab.ifs[sr->iftab.num++] = sr->if_list;
+        sr_if_rehash(&(sr->iftab));
+        return 0;
     }
 
     /* -- find the end of the list -- */
@@ -105,11 +213,15 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     while(if_walker->next)
     {if_walker = if_walker->next; }
 
-    if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
+    if_walker->next = (struct sr_if*)calloc(1, sizeof(struct sr_if));
     assert(if_walker->next);
     if_walker = if_walker->next;
+    if_walker->index = sr->iftab.num;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
     if_walker->next = 0;
+    sr->iftab.ifs[sr->iftab.num++] = if_walker;
+    sr_if_rehash(&(sr->iftab));
+    return 0;
 } /* -- sr_add_interface -- */ 
 
 /*--------------------------------------------------------------------- 
@@ -133,6 +245,7 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
 
     /* -- copy address -- */
     memcpy(if_walker->addr,addr,6);
+    sr_if_rehash(&(sr->iftab));
 
 } /* -- sr_set_ether_addr -- */
 
@@ -157,9 +270,57 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
+    sr_if_rehash(&(sr->iftab));
 
 } /* -- sr_set_ether_ip -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_if_build_templates(..)
+ * Scope: Global
+ *
+ * Fill in every interface's ARP and ICMP templates from its MAC and IP.
+ * Call once the hardware information is complete.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_if_build_templates(struct sr_instance* sr)
+{
+    struct sr_if* iface;
+    sr_ethernet_hdr_t* eth;
+    sr_arp_hdr_t* arp;
+    sr_ip_hdr_t* ip;
+    unsigned int i;
+
+    for(i = 0; i < sr->iftab.num; i++)
+    {
+        iface = sr->iftab.ifs[i];
+
+        memset(iface->arp_tmpl, 0, SR_IF_ARP_LEN);
+        eth = (sr_ethernet_hdr_t*)iface->arp_tmpl;
+        arp = (sr_arp_hdr_t*)(iface->arp_tmpl + sizeof(sr_ethernet_hdr_t));
+        memcpy(eth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+        eth->ether_type = htons(ethertype_arp);
+        arp->ar_hrd = htons(arp_hrd_ethernet);
+        arp->ar_pro = htons(ethertype_ip);
+        arp->ar_hln = ETHER_ADDR_LEN;
+        arp->ar_pln = sizeof(uint32_t);
+        memcpy(arp->ar_sha, iface->addr, ETHER_ADDR_LEN);
+        arp->ar_sip = iface->ip;
+
+        memset(iface->ip_tmpl, 0, SR_IF_IP_LEN);
+        eth = (sr_ethernet_hdr_t*)iface->ip_tmpl;
+        ip = (sr_ip_hdr_t*)(iface->ip_tmpl + sizeof(sr_ethernet_hdr_t));
+        memcpy(eth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+        eth->ether_type = htons(ethertype_ip);
+        ip->ip_v = 4;
+        ip->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+        ip->ip_ttl = INIT_TTL;
+        ip->ip_p = ip_protocol_icmp;
+        ip->ip_src = iface->ip;
+        iface->ip_tmpl_sum = cksum_partial(ip, sizeof(sr_ip_hdr_t), 0);
+    }
+} /* -- sr_if_build_templates -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_print_if_list(..)
  * Scope: Global
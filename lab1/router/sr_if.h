@@ -7,6 +7,15 @@
  *
  * Data structures and methods for handeling interfaces
  *
+ * Besides the if_list, interfaces are kept in a dense table indexed by
+ * sr_if->index, with small open-addressing hashes from name, IP and MAC
+ * to that index, so none of the lookups walk the list.
+ *
+ * Each interface also carries the constant part of the ARP and ICMP
+ * frames the router sends from it, built by sr_if_build_templates()
+ * once the addresses are known.  A reply is a copy of the template
+ * with the destination patched in.
+ *
  *---------------------------------------------------------------------------*/
 
 #ifndef sr_INTERFACE_H
@@ -28,6 +37,12 @@
 
 struct sr_instance;
 
+#define SR_IF_MAX   16   /* interfaces per router */
+#define SR_IF_HASH  64   /* slots per hash, power of two, > 2 * SR_IF_MAX */
+
+#define SR_IF_ARP_LEN (sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+#define SR_IF_IP_LEN  (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+
 /* ----------------------------------------------------------------------------
  * struct sr_if
  *
@@ -41,15 +56,45 @@ struct sr_if
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
   uint32_t speed;
+  int index;            /* slot in sr_iftab.ifs, assigned in order added */
   struct sr_if* next;
+  uint8_t arp_tmpl[SR_IF_ARP_LEN];  /* ARP from us, all but Ethernet
+                                       destination, opcode and target */
+  uint8_t ip_tmpl[SR_IF_IP_LEN];    /* Ethernet and IP header of an ICMP
+                                       message from us, all but Ethernet
+                                       destination, length and IP
+                                       destination */
+  uint64_t ip_tmpl_sum;             /* partial checksum of ip_tmpl's IP
+                                       header, for cksum_fold() */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_iftab
+ *
+ * Hash slots hold index + 1, 0 marks an empty slot.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_iftab
+{
+  struct sr_if* ifs[SR_IF_MAX];
+  unsigned int num;
+  unsigned char by_name[SR_IF_HASH];
+  unsigned char by_ip[SR_IF_HASH];
+  unsigned char by_mac[SR_IF_HASH];
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_idx(struct sr_instance* sr, int index);
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo);
+struct sr_if* sr_get_interface_by_mac(struct sr_instance* sr,
+                                      const unsigned char* addr);
 void sr_destroy_interface(struct sr_instance* sr);
-void sr_add_interface(struct sr_instance*, const char*);
+int sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
 void sr_print_if_list(struct sr_instance*);
+void sr_if_build_templates(struct sr_instance*);
 void sr_print_if(struct sr_if*);
 
 #endif /* --  sr_INTERFACE_H -- */
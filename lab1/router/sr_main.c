@@ -34,6 +34,11 @@
 #include "sr_router.h"
 #include "sr_rt.h"
 #include "sr_if.h"
+#include "sr_afpacket.h"
+#include "sr_worker.h"
+#include "sr_writer.h"
+#include "sr_ctl.h"
+#include "sr_pcaplog.h"
 
 extern char* optarg;
 
@@ -56,12 +61,10 @@ static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
-void sig_int_handler(){
-    sr_destroy_instance(&sr);
-    sleep(2.0);
-    printf(" <-- Router killed gracefully --> \n");
-    signal(SIGINT, SIG_DFL);
-    raise(SIGINT);
+/* Only asks the main loop to return; main() tears the router down, so
+   no lock the interrupted code holds is waited for. */
+void sig_int_handler(int sig){
+    sr.quit = 1;
 }
 
 int main(int argc, char **argv)
@@ -75,11 +78,29 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    unsigned int arpcache_size = SR_ARPCACHE_SZ;
+    int use_uring = 0;
+    char *ifaces = 0;
+    int busy_us = 0;
+    int cpu = -1;
+    int workers = 0;
+    int pipeline = 0;
+    int control = 0;
+    char *icmplim = 0;
+    char *rotate = 0;
+    unsigned long rotate_mb = 0;
+    unsigned long rotate_secs = 0;
+    struct sigaction sa;
 
     printf("Using %s\n", VERSION_INFO);
-    signal(SIGINT, sig_int_handler);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    /* -- no SA_RESTART: a blocked read returns and sees sr.quit -- */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_int_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, 0);
+
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:a:Ui:B:C:w:PSI:R:")) != EOF)
     {
         switch (c)
         {
@@ -111,9 +132,51 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'a':
+                arpcache_size = atoi((char *) optarg);
+                break;
+            case 'U':
+                use_uring = 1;
+                break;
+            case 'i':
+                ifaces = optarg;
+                break;
+            case 'B':
+                busy_us = atoi((char *) optarg);
+                break;
+            case 'C':
+                cpu = atoi((char *) optarg);
+                break;
+            case 'w':
+                workers = atoi((char *) optarg);
+                break;
+            case 'P':
+                pipeline = 1;
+                break;
+            case 'S':
+                control = 1;
+                break;
+            case 'I':
+                icmplim = optarg;
+                break;
+            case 'R':
+                rotate = optarg;
+                break;
         } /* switch */
     } /* -- while -- */
 
+    /* -- the writer sends what the workers forward, one at least -- */
+    if(pipeline)
+    {
+        if(workers <= 0)
+            workers = 1;
+        if(use_uring)
+        {
+            fprintf(stderr, "-P writes from its own thread, not using io_uring\n");
+            use_uring = 0;
+        }
+    }
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
 
@@ -126,6 +189,19 @@ int main(int argc, char **argv)
         strncpy(sr.template, template, 30);
 
     sr.topo_id = topo;
+    sr.arpcache_size = arpcache_size;
+    sr.use_uring = use_uring;
+    sr_busypoll_init(&(sr.busy), busy_us > 0 ? busy_us : 0);
+    if(icmplim && sr_icmplim_config(&(sr.icmplim), icmplim) != 0)
+    {
+        fprintf(stderr, "bad -I %s, want dest_ms[,type_pps[,mask]]\n", icmplim);
+        return 1;
+    }
+    if(rotate && sscanf(rotate, "%lu,%lu", &rotate_mb, &rotate_secs) < 1)
+    {
+        fprintf(stderr, "bad -R %s, want mb[,secs]\n", rotate);
+        return 1;
+    }
     strncpy(sr.host,host,32);
 
     if(! user )
@@ -143,18 +219,36 @@ int main(int argc, char **argv)
                     logfile);
             exit(1);
         }
+        if(sr_pcaplog_start(&sr, sr.logfile, logfile,
+                            (uint64_t)rotate_mb << 20, rotate_secs) != 0)
+        {
+            exit(1);
+        }
     }
 
-    Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
-    if(template)
-        Debug("Requesting topology template %s\n", template);
+    if(ifaces)
+    {
+        /* -- real interfaces stand in for the server's hardware info -- */
+        Debug("Opening interfaces %s\n", ifaces);
+        if(sr_afpacket_open(&sr, ifaces) != 0)
+        {
+            sr_afpacket_close(&sr);
+            return 1;
+        }
+    }
     else
-        Debug("Requesting topology %d\n", topo);
-
-    /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
     {
-        return 1;
+        Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
+        if(template)
+            Debug("Requesting topology template %s\n", template);
+        else
+            Debug("Requesting topology %d\n", topo);
+
+        /* connect to server and negotiate session */
+        if(sr_connect_to_server(&sr,port,server) == -1)
+        {
+            return 1;
+        }
     }
 
     if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
@@ -169,8 +263,43 @@ int main(int argc, char **argv)
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
 
+    if(workers > 0 && sr_workers_start(&sr, workers) != 0)
+    {
+        return 1;
+    }
+    if(pipeline && sr_writer_start(&sr) != 0)
+    {
+        return 1;
+    }
+    /* -- after the workers, it keeps a queue for each of them -- */
+    if(control && sr_ctl_start(&sr) != 0)
+    {
+        return 1;
+    }
+
+    /* -- after sr_init and the workers, so they keep the other cpus -- */
+    if(cpu >= 0 && sr_busypoll_pin(cpu) != 0)
+    {
+        return 1;
+    }
+
+    /* -- what VNSHWINFO does once the server is talking to us -- */
+    if(sr.afp)
+    {
+        if(sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with hardware\n");
+            return 1;
+        }
+        printf(" <-- Ready to process packets --> \n");
+        sr_arp_preresolve(&sr);
+    }
+
     /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    if(sr.afp)
+        while( !sr.quit && sr_afpacket_read(&sr) == 1);
+    else
+        while( !sr.quit && sr_read_from_server(&sr) == 1);
 
     sr_destroy_instance(&sr);
     printf(" <-- Router killed gracefully --> \n");
@@ -188,7 +317,15 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-a arp cache entries] \n");
+    printf("           [-U (use io_uring for the server connection)] \n");
+    printf("           [-i if[=ip],... (use these Linux interfaces, no server)] \n");
+    printf("           [-B us (busy poll, back off after us idle)] [-C cpu] \n");
+    printf("           [-w n (forward on n worker threads)] \n");
+    printf("           [-P (pipeline: reader, workers and a writer thread)] \n");
+    printf("           [-S (ARP, ICMP and local traffic on a control thread)] \n");
+    printf("           [-I dest_ms[,type_pps[,mask]] (ICMP error rate limits, 0 off)] \n");
+    printf("           [-R mb[,secs] (rotate the -l log at this size or age, 0 off)] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -230,13 +367,31 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
+    /* -- the ARP thread sends and flushes through everything below -- */
+    sr_arpcache_stop(&(sr->cache));
+    /* -- nothing may be forwarding while the rest goes away -- */
+    sr_workers_stop(sr);
+    sr_ctl_stop(sr);
+    sr_writer_stop(sr);
+    /* -- writes what is queued, logfile is the last file it opened -- */
+    sr_pcaplog_stop(sr);
     if(sr->logfile)
     {
         sr_dump_close(sr->logfile);
     }
+    sr_dump_stats(sr);
+    sr_rtcache_dump(&(sr->rtcache));
     sr_arpcache_destroy(&(sr->cache));
     sr_destroy_interface(sr);
     sr_destory_rt(sr);
+    free(sr->rx.buf);
+    sr_tx_destroy(&(sr->tx));
+    sr_icmplim_destroy(&(sr->icmplim));
+    sr_afpacket_close(sr);
+    sr_ctl_destroy(sr);
+    sr_writer_destroy(sr);
+    sr_workers_destroy(sr);
+    sr_pcaplog_destroy(sr);
 
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
@@ -260,8 +415,23 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    memset(&(sr->iftab), 0, sizeof(sr->iftab));
     sr->routing_table = 0;
+    sr->fib = 0;
+    sr->arpcache_size = SR_ARPCACHE_SZ;
+    sr->use_uring = 0;
+    sr->afp = 0;
+    sr->workers = 0;
+    sr->writer = 0;
+    sr->ctl = 0;
+    sr_busypoll_init(&(sr->busy), 0);
+    sr_rtcache_init(&(sr->rtcache));
+    sr_icmplim_init(&(sr->icmplim));
     sr->logfile = 0;
+    sr->pcaplog = 0;
+    memset(&(sr->stats), 0, sizeof(sr->stats));
+    memset(&(sr->rx), 0, sizeof(sr->rx));
+    sr_tx_init(&(sr->tx));
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
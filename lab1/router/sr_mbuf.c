@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_mbuf.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Fixed-size packet buffer pool with per-thread caches.  See sr_mbuf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sr_mbuf.h"
+
+struct sr_mbuf_cache
+{
+    void* bufs[SR_MBUF_CACHE];
+    unsigned int num;
+    int registered;             /* flushed back when the thread exits */
+};
+
+static pthread_once_t   sr_mbuf_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t  sr_mbuf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t    sr_mbuf_key;
+static unsigned char*   sr_mbuf_mem = 0;   /* SR_MBUF_COUNT buffers */
+static void**           sr_mbuf_free = 0;  /* stack of free buffers */
+static unsigned int     sr_mbuf_num_free = 0;
+static unsigned long    sr_mbuf_refills = 0;
+static unsigned long    sr_mbuf_exhausted = 0;
+static unsigned long    sr_mbuf_oversize = 0;
+
+static __thread struct sr_mbuf_cache sr_mbuf_tcache;
+
+/*---------------------------------------------------------------------
+ * Method: sr_mbuf_drain(..)
+ * Scope:  Local
+ *
+ * Hands the top n buffers of a thread cache back to the pool.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_mbuf_drain(struct sr_mbuf_cache* tc, unsigned int n)
+{
+    pthread_mutex_lock(&sr_mbuf_lock);
+    while(n-- > 0)
+    { sr_mbuf_free[sr_mbuf_num_free++] = tc->bufs[--(tc->num)]; }
+    pthread_mutex_unlock(&sr_mbuf_lock);
+} /* -- sr_mbuf_drain -- */
+
+static void sr_mbuf_thread_exit(void* arg)
+{
+    struct sr_mbuf_cache* tc = (struct sr_mbuf_cache*)arg;
+
+    sr_mbuf_drain(tc, tc->num);
+} /* -- sr_mbuf_thread_exit -- */
+
+static void sr_mbuf_init(void)
+{
+    unsigned int i;
+
+    pthread_key_create(&sr_mbuf_key, sr_mbuf_thread_exit);
+
+    sr_mbuf_mem = (unsigned char*)malloc((size_t)SR_MBUF_COUNT * SR_MBUF_SIZE);
+    sr_mbuf_free = (void**)malloc(SR_MBUF_COUNT * sizeof(void*));
+    if(!sr_mbuf_mem || !sr_mbuf_free)
+    {
+        /* -- every request takes the malloc() fallback -- */
+        free(sr_mbuf_mem);
+        free(sr_mbuf_free);
+        sr_mbuf_mem = 0;
+        sr_mbuf_free = 0;
+        return;
+    }
+
+    /* -- lowest addresses on top, handed out first -- */
+    for(i = 0; i < SR_MBUF_COUNT; i++)
+    { sr_mbuf_free[i] = sr_mbuf_mem + (SR_MBUF_COUNT - 1 - i) * SR_MBUF_SIZE; }
+    sr_mbuf_num_free = SR_MBUF_COUNT;
+} /* -- sr_mbuf_init -- */
+
+static int sr_mbuf_owns(const void* mem)
+{
+    return sr_mbuf_mem &&
+           (const unsigned char*)mem >= sr_mbuf_mem &&
+           (const unsigned char*)mem < sr_mbuf_mem +
+                                       (size_t)SR_MBUF_COUNT * SR_MBUF_SIZE;
+} /* -- sr_mbuf_owns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mbuf_get(..)
+ * Scope:  Global
+ *
+ * Takes a buffer from the calling thread's cache, refilling it with
+ * half a cache worth from the pool when it runs dry.
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_mbuf_get(unsigned int size)
+{
+    struct sr_mbuf_cache* tc = &sr_mbuf_tcache;
+
+    if(size > SR_MBUF_SIZE)
+    {
+        __sync_fetch_and_add(&sr_mbuf_oversize, 1);
+        return malloc(size);
+    }
+
+    if(tc->num == 0)
+    {
+        pthread_once(&sr_mbuf_once, sr_mbuf_init);
+        if(!tc->registered)
+        {
+            pthread_setspecific(sr_mbuf_key, tc);
+            tc->registered = 1;
+        }
+
+        pthread_mutex_lock(&sr_mbuf_lock);
+        while(tc->num < SR_MBUF_CACHE / 2 && sr_mbuf_num_free > 0)
+        { tc->bufs[tc->num++] = sr_mbuf_free[--sr_mbuf_num_free]; }
+        if(tc->num)
+        { sr_mbuf_refills++; }
+        else
+        { sr_mbuf_exhausted++; }
+        pthread_mutex_unlock(&sr_mbuf_lock);
+
+        if(tc->num == 0)
+        { return malloc(size); }
+    }
+
+    return tc->bufs[--(tc->num)];
+} /* -- sr_mbuf_get -- */
+
+void sr_mbuf_put(void* mem)
+{
+    struct sr_mbuf_cache* tc = &sr_mbuf_tcache;
+
+    if(!sr_mbuf_owns(mem))
+    {
+        free(mem);
+        return;
+    }
+
+    if(tc->num == SR_MBUF_CACHE)
+    { sr_mbuf_drain(tc, SR_MBUF_CACHE / 2); }
+    if(!tc->registered)
+    {
+        pthread_setspecific(sr_mbuf_key, tc);
+        tc->registered = 1;
+    }
+    tc->bufs[tc->num++] = mem;
+} /* -- sr_mbuf_put -- */
+
+void sr_mbuf_get_stats(struct sr_mbuf_stats* out)
+{
+    pthread_once(&sr_mbuf_once, sr_mbuf_init);
+
+    pthread_mutex_lock(&sr_mbuf_lock);
+    out->count = sr_mbuf_mem ? SR_MBUF_COUNT : 0;
+    out->available = sr_mbuf_num_free;
+    out->refills = sr_mbuf_refills;
+    out->exhausted = sr_mbuf_exhausted;
+    out->oversize = sr_mbuf_oversize;
+    pthread_mutex_unlock(&sr_mbuf_lock);
+} /* -- sr_mbuf_get_stats -- */
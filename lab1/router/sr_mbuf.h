@@ -0,0 +1,40 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_mbuf.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Fixed-size packet buffer pool.  SR_MBUF_COUNT buffers of SR_MBUF_SIZE
+ * bytes are carved out of one allocation up front.  Each thread keeps up
+ * to SR_MBUF_CACHE of them for itself and only takes the pool lock to
+ * refill or drain that cache in halves, so a buffer normally costs a
+ * couple of loads and stores.
+ *
+ * Requests larger than SR_MBUF_SIZE, or made while the pool is empty,
+ * fall back to malloc() and are counted; sr_mbuf_put() tells the two
+ * apart by address.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_MBUF_H
+#define SR_MBUF_H
+
+#define SR_MBUF_SIZE   2048  /* bytes per buffer, headroom included */
+#define SR_MBUF_COUNT  1024
+#define SR_MBUF_CACHE  32    /* buffers a thread holds on to */
+
+struct sr_mbuf_stats
+{
+    unsigned int  count;       /* buffers in the pool */
+    unsigned int  available;   /* not handed out nor sitting in a thread cache */
+    unsigned long refills;     /* thread caches refilled from the pool */
+    unsigned long exhausted;   /* malloc() fallbacks, pool empty */
+    unsigned long oversize;    /* malloc() fallbacks, request too large */
+};
+
+/* Returns size bytes, or 0 if even the fallback fails. */
+void* sr_mbuf_get(unsigned int size);
+void  sr_mbuf_put(void* mem);
+void  sr_mbuf_get_stats(struct sr_mbuf_stats* out);
+
+#endif /* -- SR_MBUF_H -- */
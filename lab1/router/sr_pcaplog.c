@@ -0,0 +1,316 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pcaplog.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Background packet log.  See sr_pcaplog.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <assert.h>
+
+#include "sr_pcaplog.h"
+#include "sr_router.h"
+#include "sr_busypoll.h"
+#include "sr_dumper.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_add(..)
+ * Scope:  Global
+ *
+ * Claims the slot at tail, the one whose sequence says it is free for
+ * this lap, copies the frame into it and hands it to the log thread by
+ * storing pos + 1 in its sequence.  A slot still a lap behind means the
+ * ring is full.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pcaplog_add(struct sr_pcaplog* log, const uint8_t* frame,
+                    unsigned int len)
+{
+    struct sr_pcaplog_slot* s;
+    unsigned int pos, seq;
+    int diff;
+
+    pos = __atomic_load_n(&(log->tail), __ATOMIC_RELAXED);
+    for(;;)
+    {
+        s = &(log->slots[pos & (SR_PCAPLOG_SLOTS - 1)]);
+        seq = __atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE);
+        diff = (int)(seq - pos);
+        if(diff == 0)
+        {
+            if(__atomic_compare_exchange_n(&(log->tail), &pos, pos + 1, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            { break; }
+        }
+        else if(diff < 0)
+        {
+            __atomic_fetch_add(&(log->drops), 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        { pos = __atomic_load_n(&(log->tail), __ATOMIC_RELAXED); }
+    }
+
+    s->stamp = sr_busypoll_wall();
+    s->len = len;
+    s->caplen = len < SR_PCAPLOG_SNAP ? len : SR_PCAPLOG_SNAP;
+    memcpy(s->data, frame, s->caplen);
+    __atomic_store_n(&(s->seq), pos + 1, __ATOMIC_RELEASE);
+
+    sr_bell_ring(&(log->bell));
+} /* -- sr_pcaplog_add -- */
+
+/* writes out the block gathered so far */
+static void sr_pcaplog_write(struct sr_pcaplog* log)
+{
+    if(log->fill == 0)
+    { return; }
+    if(fwrite(log->block, log->fill, 1, log->fp) != 1)
+    { perror("sr_pcaplog: fwrite"); }
+    fflush(log->fp);
+    log->file_bytes += log->fill;
+    log->blocks++;
+    log->fill = 0;
+} /* -- sr_pcaplog_write -- */
+
+/* stays with the current file for good, dropping the new one if made */
+static void sr_pcaplog_abandon(struct sr_pcaplog* log, FILE* fp,
+                               const char* tmp)
+{
+    if(fp)
+    {
+        sr_dump_close(fp);
+        remove(tmp);
+    }
+    log->rotate_bytes = 0;
+    log->rotate_secs = 0;
+} /* -- sr_pcaplog_abandon -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_rotate(..)
+ * Scope:  Local
+ *
+ * Starts a new file as name.tmp, then moves the finished one out of the
+ * way as name.N and the new one in under name.  If any step fails the
+ * log goes on in the current file, and rotation is turned off so the
+ * failure is reported only once.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_pcaplog_rotate(struct sr_pcaplog* log, uint64_t now)
+{
+    char old[sizeof(log->name) + 16];
+    char tmp[sizeof(log->name) + 16];
+    FILE* fp;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", log->name);
+    snprintf(old, sizeof(old), "%s.%u", log->name, log->rotations + 1);
+    if((fp = sr_dump_open(tmp, 0, SR_PCAPLOG_SNAP)) == 0)
+    {
+        fprintf(stderr, "\nsr_pcaplog: no more rotation of %s\n", log->name);
+        sr_pcaplog_abandon(log, 0, 0);
+        return;
+    }
+    if(rename(log->name, old) != 0)
+    {
+        perror("sr_pcaplog: rename, no more rotation");
+        sr_pcaplog_abandon(log, fp, tmp);
+        return;
+    }
+    if(rename(tmp, log->name) != 0)
+    {
+        perror("sr_pcaplog: rename, no more rotation");
+        rename(old, log->name);     /* -- the current file back -- */
+        sr_pcaplog_abandon(log, fp, tmp);
+        return;
+    }
+    sr_dump_close(log->fp);
+    log->fp = fp;
+    log->file_bytes = sizeof(struct pcap_file_header);
+    log->file_opened = now;
+    log->rotations++;
+} /* -- sr_pcaplog_rotate -- */
+
+static int sr_pcaplog_due(struct sr_pcaplog* log, uint64_t now)
+{
+    if(log->fp == stdout)
+    { return 0; }
+    if(log->rotate_bytes && log->file_bytes >= log->rotate_bytes)
+    { return 1; }
+    if(log->rotate_secs &&
+       now - log->file_opened >= log->rotate_secs * 1000000000ULL)
+    { return 1; }
+    return 0;
+} /* -- sr_pcaplog_due -- */
+
+/* turns the filled slots into pcap records; returns how many */
+static unsigned int sr_pcaplog_drain(struct sr_pcaplog* log)
+{
+    struct sr_pcaplog_slot* s;
+    struct pcap_sf_pkthdr h;
+    unsigned int n = 0;
+    uint64_t now;
+
+    for(;;)
+    {
+        s = &(log->slots[log->head & (SR_PCAPLOG_SLOTS - 1)]);
+        if(__atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE) != log->head + 1)
+        { break; }
+
+        if(log->fill + sizeof(h) + s->caplen > SR_PCAPLOG_BLOCK)
+        {
+            sr_pcaplog_write(log);
+            now = sr_busypoll_now();
+            if(sr_pcaplog_due(log, now))
+            { sr_pcaplog_rotate(log, now); }
+        }
+        h.ts.tv_sec = (int)(s->stamp / 1000000000ULL);
+        h.ts.tv_usec = (int)((s->stamp % 1000000000ULL) / 1000);
+        h.caplen = s->caplen;
+        h.len = s->len;
+        memcpy(log->block + log->fill, &h, sizeof(h));
+        memcpy(log->block + log->fill + sizeof(h), s->data, s->caplen);
+        log->fill += sizeof(h) + s->caplen;
+
+        __atomic_store_n(&(s->seq), log->head + SR_PCAPLOG_SLOTS, __ATOMIC_RELEASE);
+        log->head++;
+        n++;
+    }
+    log->records += n;
+    return n;
+} /* -- sr_pcaplog_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pcaplog_main(..)
+ * Scope:  Local
+ *
+ * Drains the ring for as long as it has records and writes what it has
+ * once it is empty, so a block goes out whole under load and a lone
+ * frame reaches the file within a wakeup.  Sleeps on its bell, which
+ * also times the age limit.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_pcaplog_main(void* arg)
+{
+    struct sr_pcaplog* log = (struct sr_pcaplog*)arg;
+    struct sr_pcaplog_slot* s;
+    uint64_t now;
+    unsigned int seq;
+
+    while(!log->stop)
+    {
+        if(sr_pcaplog_drain(log))
+        { continue; }
+
+        sr_pcaplog_write(log);
+        now = sr_busypoll_now();
+        if(sr_pcaplog_due(log, now))
+        { sr_pcaplog_rotate(log, now); }
+
+        seq = sr_bell_arm(&(log->bell));
+        s = &(log->slots[log->head & (SR_PCAPLOG_SLOTS - 1)]);
+        if(__atomic_load_n(&(s->seq), __ATOMIC_ACQUIRE) != log->head + 1 && !log->stop)
+        { sr_bell_wait(&(log->bell), seq); }
+        else
+        { sr_bell_disarm(&(log->bell)); }
+    }
+
+    sr_pcaplog_drain(log);
+    sr_pcaplog_write(log);
+    return 0;
+} /* -- sr_pcaplog_main -- */
+
+int sr_pcaplog_start(struct sr_instance* sr, FILE* fp, const char* name,
+                     uint64_t rotate_bytes, unsigned int rotate_secs)
+{
+    struct sr_pcaplog* log;
+    sigset_t all, old;
+    unsigned int i;
+    int err;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(fp);
+    assert(name);
+
+    if((log = (struct sr_pcaplog*)calloc(1, sizeof(struct sr_pcaplog))) == 0 ||
+       (log->slots = (struct sr_pcaplog_slot*)malloc(SR_PCAPLOG_SLOTS *
+                                                     sizeof(struct sr_pcaplog_slot))) == 0 ||
+       (log->block = (uint8_t*)malloc(SR_PCAPLOG_BLOCK)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_pcaplog_start)\n");
+        if(log)
+        {
+            free(log->slots);
+            free(log);
+        }
+        return -1;
+    }
+    for(i = 0; i < SR_PCAPLOG_SLOTS; i++)
+    { log->slots[i].seq = i; }
+    log->fp = fp;
+    strncpy(log->name, name, sizeof(log->name) - 1);
+    log->rotate_bytes = rotate_bytes;
+    log->rotate_secs = rotate_secs;
+    log->file_bytes = sizeof(struct pcap_file_header);
+    log->file_opened = sr_busypoll_now();
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    err = pthread_create(&(log->thread), 0, sr_pcaplog_main, log);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    if(err != 0)
+    {
+        fprintf(stderr, "Error: cannot start the log thread: %s\n", strerror(err));
+        free(log->block);
+        free(log->slots);
+        free(log);
+        return -1;
+    }
+    sr->pcaplog = log;
+    return 0;
+} /* -- sr_pcaplog_start -- */
+
+void sr_pcaplog_stop(struct sr_instance* sr)
+{
+    struct sr_pcaplog* log = sr->pcaplog;
+
+    if(!log || log->stop)
+    { return; }
+
+    log->stop = 1;
+    sr_bell_ring(&(log->bell));
+    pthread_join(log->thread, 0);
+    sr->logfile = log->fp;
+} /* -- sr_pcaplog_stop -- */
+
+void sr_pcaplog_destroy(struct sr_instance* sr)
+{
+    if(!sr->pcaplog)
+    { return; }
+    sr_pcaplog_stop(sr);
+    free(sr->pcaplog->block);
+    free(sr->pcaplog->slots);
+    free(sr->pcaplog);
+    sr->pcaplog = 0;
+} /* -- sr_pcaplog_destroy -- */
+
+void sr_pcaplog_dump_stats(struct sr_instance* sr)
+{
+    struct sr_pcaplog* log = sr->pcaplog;
+
+    fprintf(stderr, "packet log:\n");
+    fprintf(stderr, "  %lu records in %lu writes, %lu dropped (ring full), "
+            "%u rotations, %lu sleeps, %lu wakes\n",
+            log->records, log->blocks, log->drops, log->rotations,
+            log->bell.waits, log->bell.rings);
+} /* -- sr_pcaplog_dump_stats -- */
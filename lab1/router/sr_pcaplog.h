@@ -0,0 +1,98 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pcaplog.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Packet log (-l) written in the background.  sr_log_packet() only
+ * copies a frame's first PACKET_DUMP_SIZE bytes and a timestamp into a
+ * slot of a bounded ring and returns; a log thread turns the slots into
+ * pcap records, gathers them into blocks of SR_PCAPLOG_BLOCK bytes and
+ * writes each block with one fwrite() to the file sr_dump_open() made.
+ *
+ * Any thread may log, so the ring takes several producers without a
+ * lock: a producer claims a slot by moving tail with a compare and
+ * swap, fills it and publishes it through the slot's sequence number;
+ * the log thread frees it the same way.  A full ring drops the record
+ * and counts it rather than hold up forwarding.
+ *
+ * With -R the file is rotated once it reaches a size or an age: a new
+ * file is opened, the finished one is renamed to name.1, name.2, ...
+ * and the new one takes the original name.  If that cannot be done the
+ * log stays in the current file and rotation stops.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PCAPLOG_H
+#define SR_PCAPLOG_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_ring.h"
+
+#define SR_PCAPLOG_SLOTS  1024          /* power of two */
+#define SR_PCAPLOG_SNAP   1024          /* bytes kept per frame, PACKET_DUMP_SIZE */
+#define SR_PCAPLOG_BLOCK  (256 * 1024)  /* bytes per write */
+
+struct sr_instance;
+
+struct sr_pcaplog_slot
+{
+    volatile unsigned int seq;  /* pos + 1 once filled, pos + SLOTS once free */
+    unsigned int caplen;
+    unsigned int len;           /* length of the frame */
+    uint64_t stamp;             /* ns since the epoch */
+    uint8_t data[SR_PCAPLOG_SNAP];
+};
+
+struct sr_pcaplog
+{
+    volatile unsigned int tail;         /* producers */
+    char pad0[SR_RING_LINE - sizeof(unsigned int)];
+    unsigned int head;                  /* log thread */
+    char pad1[SR_RING_LINE - sizeof(unsigned int)];
+    struct sr_pcaplog_slot* slots;
+    struct sr_bell bell;        /* the log thread sleeps on the ring */
+    volatile int stop;
+    pthread_t thread;
+    FILE* fp;
+    char name[256];
+    uint64_t rotate_bytes;      /* 0: no size limit */
+    unsigned int rotate_secs;   /* 0: no age limit */
+    uint64_t file_bytes;        /* written to the current file */
+    uint64_t file_opened;       /* monotonic ns */
+    unsigned int rotations;
+    uint8_t* block;
+    unsigned int fill;
+    unsigned long records;
+    unsigned long blocks;
+    unsigned long drops;        /* ring full */
+};
+
+/* Starts logging to fp, already opened as name by sr_dump_open(),
+   rotating it at rotate_bytes or rotate_secs if not 0.  Returns 0 or
+   -1. */
+int  sr_pcaplog_start(struct sr_instance* sr, FILE* fp, const char* name,
+                      uint64_t rotate_bytes, unsigned int rotate_secs);
+
+/* Writes what is queued and stops the log thread; sr->logfile is then
+   the file it was writing. */
+void sr_pcaplog_stop(struct sr_instance* sr);
+void sr_pcaplog_destroy(struct sr_instance* sr);
+
+/* Queues a record of len bytes of frame.  Safe from any thread. */
+void sr_pcaplog_add(struct sr_pcaplog* log, const uint8_t* frame,
+                    unsigned int len);
+
+void sr_pcaplog_dump_stats(struct sr_instance* sr);
+
+#endif /* -- SR_PCAPLOG_H -- */
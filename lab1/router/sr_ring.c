@@ -0,0 +1,114 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Single producer, single consumer frame rings and their doorbells.
+ * See sr_ring.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <time.h>
+
+#ifdef _LINUX_
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "sr_ring.h"
+
+void sr_ring_init(struct sr_ring* r)
+{
+    memset(r, 0, sizeof(*r));
+} /* -- sr_ring_init -- */
+
+unsigned int sr_ring_room(struct sr_ring* r)
+{
+    return SR_RING_SIZE - (r->pushed - __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE));
+} /* -- sr_ring_room -- */
+
+void sr_ring_push(struct sr_ring* r, uint8_t* frame, unsigned int len,
+                  struct sr_if* iface, uint64_t stamp, unsigned int tag)
+{
+    struct sr_ring_slot* s = &(r->slot[r->pushed & (SR_RING_SIZE - 1)]);
+    unsigned int depth;
+
+    s->frame = frame;
+    s->len = len;
+    s->iface = iface;
+    s->stamp = stamp;
+    s->tag = tag;
+    r->pushed++;
+
+    depth = r->pushed - r->head;
+    if(depth > r->max_depth)
+    { r->max_depth = depth; }
+} /* -- sr_ring_push -- */
+
+int sr_ring_publish(struct sr_ring* r)
+{
+    if(r->pushed == r->tail)
+    { return 0; }
+    __atomic_store_n(&(r->tail), r->pushed, __ATOMIC_SEQ_CST);
+    return 1;
+} /* -- sr_ring_publish -- */
+
+unsigned int sr_ring_avail(struct sr_ring* r)
+{
+    return __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE) - r->head;
+} /* -- sr_ring_avail -- */
+
+struct sr_ring_slot* sr_ring_peek(struct sr_ring* r, unsigned int i)
+{
+    return &(r->slot[(r->head + i) & (SR_RING_SIZE - 1)]);
+} /* -- sr_ring_peek -- */
+
+void sr_ring_pop(struct sr_ring* r, unsigned int n)
+{
+    __atomic_store_n(&(r->head), r->head + n, __ATOMIC_RELEASE);
+} /* -- sr_ring_pop -- */
+
+unsigned int sr_bell_arm(struct sr_bell* b)
+{
+    unsigned int seq = __atomic_load_n(&(b->seq), __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&(b->armed), 1, __ATOMIC_SEQ_CST);
+    return seq;
+} /* -- sr_bell_arm -- */
+
+void sr_bell_wait(struct sr_bell* b, unsigned int seq)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = SR_BELL_WAIT_MS * 1000000L;
+    b->waits++;
+#ifdef _LINUX_
+    syscall(SYS_futex, &(b->seq), FUTEX_WAIT_PRIVATE, seq, &ts, 0, 0);
+#else
+    ts.tv_nsec = 50 * 1000;
+    nanosleep(&ts, 0);
+#endif
+    sr_bell_disarm(b);
+} /* -- sr_bell_wait -- */
+
+void sr_bell_disarm(struct sr_bell* b)
+{
+    __atomic_store_n(&(b->armed), 0, __ATOMIC_RELAXED);
+} /* -- sr_bell_disarm -- */
+
+void sr_bell_ring(struct sr_bell* b)
+{
+    /* -- the first ring takes the bell down, the others need not wake -- */
+    if(!__atomic_load_n(&(b->armed), __ATOMIC_SEQ_CST) ||
+       !__atomic_exchange_n(&(b->armed), 0, __ATOMIC_SEQ_CST))
+    { return; }
+    __atomic_fetch_add(&(b->seq), 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&(b->rings), 1, __ATOMIC_RELAXED);
+#ifdef _LINUX_
+    syscall(SYS_futex, &(b->seq), FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+#endif
+} /* -- sr_bell_ring -- */
@@ -0,0 +1,94 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ring.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Single producer, single consumer ring of frames between two threads,
+ * and the doorbell a consumer sleeps on while its rings are empty.
+ *
+ * The indices only grow.  The producer fills slots past tail and makes
+ * them visible with sr_ring_publish(), once per batch; the consumer
+ * takes them up to tail and hands the slots back by moving head.  No
+ * lock is taken either way.  max_depth is the ring's high-water mark,
+ * stalls counts the times the producer found it full.
+ *
+ * A consumer about to sleep arms its bell, looks at its rings once more
+ * and sleeps only if they are still empty and nobody rang since.  The
+ * producer publishes before it checks whether the bell is armed, both
+ * sequentially consistent, so one of them always sees the other.  The
+ * producer that finds the bell armed disarms it and wakes the consumer;
+ * those ringing after it, before the consumer runs, skip the syscall.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RING_H
+#define SR_RING_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_RING_SIZE     256   /* frames, power of two */
+#define SR_RING_LINE     64    /* keeps the two sides' indices apart */
+#define SR_BELL_WAIT_MS  100   /* longest sleep without a ring */
+
+struct sr_if;
+
+struct sr_ring_slot
+{
+    uint8_t* frame;             /* pool buffer, owned by the ring */
+    unsigned int len;
+    unsigned int tag;           /* for the consumer, 0 if unused */
+    struct sr_if* iface;
+    uint64_t stamp;             /* when the frame was received, ns */
+};
+
+struct sr_ring
+{
+    volatile unsigned int head;         /* consumer */
+    char pad0[SR_RING_LINE - sizeof(unsigned int)];
+    volatile unsigned int tail;         /* producer, published */
+    unsigned int pushed;                /* producer, not yet published */
+    unsigned int max_depth;
+    unsigned long stalls;
+    char pad1[SR_RING_LINE - 3 * sizeof(unsigned int) - sizeof(unsigned long)];
+    struct sr_ring_slot slot[SR_RING_SIZE];
+};
+
+struct sr_bell
+{
+    volatile unsigned int seq;  /* bumped by every ring that may wake */
+    volatile int armed;         /* the consumer is about to sleep */
+    unsigned long waits;        /* sleeps, by the consumer */
+    unsigned long rings;        /* wakeups, by the producers */
+};
+
+void sr_ring_init(struct sr_ring* r);
+
+/* -- producer -- */
+unsigned int sr_ring_room(struct sr_ring* r);
+void sr_ring_push(struct sr_ring* r, uint8_t* frame, unsigned int len,
+                  struct sr_if* iface, uint64_t stamp, unsigned int tag);
+/* Makes the pushed slots visible; returns 1 if there were any. */
+int  sr_ring_publish(struct sr_ring* r);
+
+/* -- consumer -- */
+unsigned int sr_ring_avail(struct sr_ring* r);
+struct sr_ring_slot* sr_ring_peek(struct sr_ring* r, unsigned int i);
+void sr_ring_pop(struct sr_ring* r, unsigned int n);
+
+/* Returns the sequence to pass to sr_bell_wait(); the caller checks its
+   rings again before waiting. */
+unsigned int sr_bell_arm(struct sr_bell* b);
+void sr_bell_wait(struct sr_bell* b, unsigned int seq);
+void sr_bell_disarm(struct sr_bell* b);
+
+/* Wakes the consumer if it sleeps or is about to. */
+void sr_bell_ring(struct sr_bell* b);
+
+#endif /* -- SR_RING_H -- */
@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include <assert.h>
+#include <signal.h>
 
 
 #include "sr_if.h"
@@ -21,6 +22,15 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_fib.h"
+#include "sr_adj.h"
+#include "sr_mbuf.h"
+#include "sr_uring.h"
+#include "sr_afpacket.h"
+#include "sr_worker.h"
+#include "sr_writer.h"
+#include "sr_ctl.h"
+#include "sr_pcaplog.h"
 
 
 /*---------------------------------------------------------------------
@@ -37,16 +47,24 @@ void sr_init(struct sr_instance* sr)
     assert(sr);
 
     /* Initialize cache and cache cleanup thread */
-    sr_arpcache_init(&(sr->cache));
+    if(sr_arpcache_init(&(sr->cache), sr->arpcache_size) != 0)
+    {
+        fprintf(stderr, "Error initializing ARP cache\n");
+        exit(1);
+    }
 
     pthread_attr_init(&(sr->attr));
     pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
     pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
     pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
-    pthread_t thread;
 
-    pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
-    pthread_detach(thread);
+    /* joined by sr_arpcache_stop(); SIGINT is left to the main thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if(pthread_create(&(sr->cache.thread), &(sr->attr), sr_arpcache_timeout, sr) == 0)
+        sr->cache.thread_running = 1;
+    pthread_sigmask(SIG_SETMASK, &old, 0);
     
     /* Add initialization code here! */
 
@@ -64,7 +82,7 @@ void sr_init(struct sr_instance* sr)
  * Note: Both the packet buffer and the character's memory are handled
  * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
  * packet instead if you intend to keep it around beyond the scope of
- * the method call.
+ * the method call.  The frame may be rewritten and sent in place.
  *
  *---------------------------------------------------------------------*/
 int isARP(uint8_t *data, unsigned int len)
@@ -83,43 +101,86 @@ int isARPRequest(uint8_t *data, unsigned int len)
   return 0;
 }
 
-int isValidIPPacket(uint8_t *data, unsigned int len)
+/* drop counters of the calling worker, or the router's own */
+static struct sr_router_stats* routerStats(struct sr_instance* sr)
+{
+  struct sr_worker* w = sr_worker_self();
+  return w ? &(w->stats) : &(sr->stats);
+}
+
+/*---------------------------------------------------------------------
+ * Method: isValidIPPacket(..)
+ * Scope:  Global
+ *
+ * Returns 1 for an IPv4 frame whose header is sound: version 4, header
+ * length of at least 20 bytes, total length covering the header and
+ * fitting the frame, and a correct checksum.  Everything is checked in
+ * one pass over the header; failures are counted and the frame should
+ * be dropped.
+ *
+ *---------------------------------------------------------------------*/
+int isValidIPPacket(struct sr_instance* sr, uint8_t *data, unsigned int len)
 {
   if(len < sizeof(sr_ethernet_hdr_t))
     return 0;
   
-  if(ethertype(data) == 2048)
+  if(ethertype(data) != ethertype_ip)
+    return 0;
+
+  data += sizeof(sr_ethernet_hdr_t);
+  len -= sizeof(sr_ethernet_hdr_t);
+
+  if(len < sizeof(sr_ip_hdr_t))
   {
-    data += sizeof(sr_ethernet_hdr_t);
+    routerStats(sr)->ip_too_short++;
+    return 0;
+  }
 
-    uint16_t checkSumResult = cksum(data, sizeof(sr_ip_hdr_t));
-    if( checkSumResult == (uint16_t)0xFFFF)
-    {
-      return 1;
-    }
-    else{
+  unsigned int hdrLen = (data[0] & 0x0f) * 4;
+  unsigned int totalLen = (data[2] << 8) | data[3];
 
-      printf("checksum invalid, will NOT drop the packet! %x\n", checkSumResult);
-      return 1;
-    }
+  if((data[0] >> 4) != 4 || hdrLen < sizeof(sr_ip_hdr_t))
+  {
+    routerStats(sr)->ip_bad_hdr++;
+    return 0;
+  }
+  if(totalLen < hdrLen || totalLen > len)
+  {
+    routerStats(sr)->ip_bad_len++;
+    return 0;
   }
 
-  return 0;
+  /* one's complement sum over the header, checksum field included,
+     four bytes at a time; a correct header sums to 0xffff */
+  uint64_t sum = 0;
+  unsigned int i;
+  for(i = 0; i < hdrLen; i += 4)
+  {
+    uint32_t word;
+    memcpy(&word, data + i, sizeof(word));
+    sum += word;
+  }
+  while(sum > 0xffff)
+    sum = (sum >> 16) + (sum & 0xffff);
+
+  if(sum != 0xffff)
+  {
+    routerStats(sr)->ip_bad_cksum++;
+    return 0;
+  }
+
+  return 1;
 }
 
+/* the MAC extractors point into the frame, which outlives their use */
 uint8_t* extractSenderMAC(uint8_t *data, unsigned int len)
 {
-  uint8_t* MACAddr = (uint8_t*)malloc(sizeof(uint8_t)* ETHER_ADDR_LEN);
-  memcpy(MACAddr, data+22, ETHER_ADDR_LEN);
-  return MACAddr;
-
+  return data+22;
 }
 
 uint8_t* extractTargetMAC(uint8_t *data, unsigned int len)
 {
-  uint8_t* MACAddr = (uint8_t*)malloc(sizeof(uint8_t) * ETHER_ADDR_LEN);
-  memcpy(MACAddr, data+32, ETHER_ADDR_LEN);
-  return MACAddr;
+  return data+32;
 }
 
 uint32_t extractSenderIP(uint8_t *data, unsigned int len)
@@ -147,58 +208,24 @@ uint32_t extractTargetIP(uint8_t *data, unsigned int len)
   return htonl(ip);
 }
 
-uint8_t* findMyMAC(struct sr_instance* sr, uint32_t ipaddr)
-{
-  struct sr_if *interface = sr->if_list;
-  uint8_t* MACAddr = NULL;
-  while(interface)
-  {
-    if(interface->ip == ipaddr)
-    {
-      MACAddr = interface->addr;
-      break;
-    }
-    else
-    {
-      interface = interface->next;
-    }
-  }
-
-  return MACAddr;
-}
-
-int generateARPReply(uint8_t* data, uint8_t* dst, uint32_t dstIP, uint8_t* src, uint32_t srcIP)
+/*---------------------------------------------------------------------
+ * Method: buildARP(..)
+ * Scope:  Local
+ *
+ * An ARP frame from interface from: its template with the Ethernet
+ * destination, the opcode and the target filled in.
+ *
+ *---------------------------------------------------------------------*/
+static void buildARP(uint8_t* data, const struct sr_if* from, uint16_t op, const uint8_t* dstMAC, const uint8_t* tha, uint32_t tip)
 {
-  
-  memcpy(data, dst, ETHER_ADDR_LEN);
-  data += ETHER_ADDR_LEN;
-  memcpy(data, src, ETHER_ADDR_LEN);
-  data += ETHER_ADDR_LEN;
-  
-  *data = 0x08; data++; /*Type*/
-  *data = 0x06; data++; 
-  *data = 0x00; data++; /*hardware type*/
-  *data = 0x01; data++;
-  *data = 0x08; data++; /*protocol type*/
-  *data = 0x00; data++;
-  *data = 0x06; data++; /*hardware size*/
-  *data = 0x04; data++; /*protocol size*/
-
-  *data = 0x00; data++; /*op code*/
-  *data = 0x02; data++;
-
-  memcpy(data, src, ETHER_ADDR_LEN);
-  data += ETHER_ADDR_LEN;
-
-  memcpy(data, &srcIP, sizeof(srcIP));
-  data += sizeof(srcIP);
-
-  memcpy(data, dst, ETHER_ADDR_LEN);
-  data += ETHER_ADDR_LEN;
-
-  memcpy(data, &dstIP, sizeof(dstIP));
-
-  return sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t);
+  sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)data;
+  sr_arp_hdr_t *arpData = (sr_arp_hdr_t*)(data + sizeof(sr_ethernet_hdr_t));
+
+  memcpy(data, from->arp_tmpl, SR_IF_ARP_LEN);
+  memcpy(ethData->ether_dhost, dstMAC, ETHER_ADDR_LEN);
+  arpData->ar_op = htons(op);
+  memcpy(arpData->ar_tha, tha, ETHER_ADDR_LEN);
+  arpData->ar_tip = tip;
 }
 
 int isForMe(struct sr_instance* sr, uint8_t * data, int len)
@@ -206,22 +233,21 @@ int isForMe(struct sr_instance* sr, uint8_t * data, int len)
   data += sizeof(sr_ethernet_hdr_t);
   len -= sizeof(sr_ethernet_hdr_t);
   sr_ip_hdr_t *iphdr = (sr_ip_hdr_t *)(data);
-  struct sr_if *interface = sr->if_list;
-  while(interface)
-  {
-    if(interface->ip == iphdr->ip_dst)
-    {
-      return 1;
-    }
-
-    interface = interface->next;
-  }
 
-  return 0;
+  return sr_get_interface_by_ip(sr, iphdr->ip_dst) != NULL;
 }
 
 
-void handleIncomingICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */)
+/*---------------------------------------------------------------------
+ * Method: handleIncomingICMP(..)
+ * Scope:  Global
+ *
+ * Echo requests are turned into replies in the receive buffer itself.
+ * Swapping the addresses leaves the checksums alone; the TTL and the
+ * ICMP type are patched in with cksum_update().
+ *
+ *---------------------------------------------------------------------*/
+void handleIncomingICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */)
 {
   uint8_t *data = packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t);
   
@@ -229,37 +255,33 @@ void handleIncomingICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsi
   {
     case 0x08:
     {
-      uint8_t *resData = (uint8_t*)calloc(sizeof(uint8_t), len);
-      memcpy(resData, packet, len);
-      
-      sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)resData;
-      
-      memcpy(ethData->ether_dhost, ((sr_ethernet_hdr_t *)packet)->ether_shost, ETHER_ADDR_LEN);
-      memcpy(ethData->ether_shost, ((sr_ethernet_hdr_t *)packet)->ether_dhost, ETHER_ADDR_LEN);
-      ethData->ether_type = ((sr_ethernet_hdr_t *)packet)->ether_type;
-
-
-      sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)((uint8_t*)resData + sizeof(sr_ethernet_hdr_t));
-
-      /*memcpy(ipData, (packet + sizeof(sr_ethernet_hdr_t)), sizeof(sr_ip_hdr_t));*/
-      ipData->ip_dst = ((sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t)))->ip_src;
-      ipData->ip_src = ((sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t)))->ip_dst;
-      ipData->ip_ttl = 255;
-      ipData->ip_sum = 0;
-      ipData->ip_sum = (cksum(ipData, sizeof(sr_ip_hdr_t)));
+      sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)packet;
+      uint8_t mac[ETHER_ADDR_LEN];
+
+      memcpy(mac, ethData->ether_dhost, ETHER_ADDR_LEN);
+      memcpy(ethData->ether_dhost, ethData->ether_shost, ETHER_ADDR_LEN);
+      memcpy(ethData->ether_shost, mac, ETHER_ADDR_LEN);
+
+      sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+      uint32_t ip = ipData->ip_dst;
+      uint16_t oldWord, newWord;
+
+      ipData->ip_dst = ipData->ip_src;
+      ipData->ip_src = ip;
+      memcpy(&oldWord, &ipData->ip_ttl, sizeof(oldWord));
+      ipData->ip_ttl = INIT_TTL;
+      memcpy(&newWord, &ipData->ip_ttl, sizeof(newWord));
+      ipData->ip_sum = cksum_update(ipData->ip_sum, oldWord, newWord);
       
       sr_icmp_hdr_t *icmpData = (sr_icmp_hdr_t*)((uint8_t*)ipData + sizeof(sr_ip_hdr_t));
 
-      /*memcpy(icmpData, packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t), 8);*/
+      memcpy(&oldWord, icmpData, sizeof(oldWord));
       icmpData->icmp_type = 0;
       icmpData->icmp_code = 0;
-      icmpData->icmp_sum = 0;
-      icmpData->icmp_sum = (cksum(icmpData, ntohs(ipData->ip_len)-sizeof(sr_ip_hdr_t)));
-      
-
-      sr_send_packet(sr, resData, len, interface);
+      memcpy(&newWord, icmpData, sizeof(newWord));
+      icmpData->icmp_sum = cksum_update(icmpData->icmp_sum, oldWord, newWord);
 
-      free(resData);
+      sr_send_packet_if(sr, packet, len, interface);
       break;
     }
     default:
@@ -268,10 +290,28 @@ void handleIncomingICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsi
   }
 }
 
-void generateICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */, uint8_t icmp_type, uint8_t icmp_code)
+/* is an ICMP error about packet within the rate limits? */
+static int allowICMP(struct sr_instance* sr, uint8_t * packet/* lent */, uint8_t icmp_type)
+{
+  sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+
+  return sr_icmplim_allow(&(sr->icmplim), icmp_type, ipData->ip_src);
+}
+
+/*---------------------------------------------------------------------
+ * Method: buildICMP(..)
+ * Scope:  Local
+ *
+ * Sends an ICMP error about packet from interfaceStruct.  The headers
+ * come from the interface's template; the IP checksum is finished from
+ * its partial sum with the length and destination, the ICMP one is
+ * summed over the message.
+ *
+ *---------------------------------------------------------------------*/
+static void buildICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interfaceStruct/* lent */, uint8_t icmp_type, uint8_t icmp_code)
 {
-  struct sr_if* interfaceStruct = sr_get_interface(sr, interface);
   int appendDataLen = ((len > 576)? 576 :len) - sizeof(sr_ethernet_hdr_t);
+  sr_ip_hdr_t *origIP = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
 
   unsigned int resDataLen;
   if(icmp_type == TYPE_DST_UNREACHABLE)
@@ -281,356 +321,574 @@ void generateICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned i
   else
     resDataLen = sizeof(sr_ethernet_hdr_t)+ sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t);
 
-  uint8_t *resData = (uint8_t*)malloc(sizeof(uint8_t) * resDataLen);
+  uint8_t *resData = sr_packet_alloc(resDataLen);
+  if(!resData)
+    return;
 
-  sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)resData;
-      
-  memcpy(ethData->ether_dhost, ((sr_ethernet_hdr_t *)packet)->ether_shost, ETHER_ADDR_LEN);
-  memcpy(ethData->ether_shost, interfaceStruct->addr, ETHER_ADDR_LEN);
-  ethData->ether_type = ((sr_ethernet_hdr_t *)packet)->ether_type;
+  memcpy(resData, interfaceStruct->ip_tmpl, SR_IF_IP_LEN);
+  memcpy(((sr_ethernet_hdr_t *)resData)->ether_dhost, ((sr_ethernet_hdr_t *)packet)->ether_shost, ETHER_ADDR_LEN);
 
   sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)((uint8_t*)resData + sizeof(sr_ethernet_hdr_t));
-  memcpy(ipData, (packet + sizeof(sr_ethernet_hdr_t)), sizeof(sr_ip_hdr_t));
-  ipData->ip_p = 1 ;
-  ipData->ip_dst = ((sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t)))->ip_src;
-  ipData->ip_src = interfaceStruct->ip;
   ipData->ip_len = htons(resDataLen - sizeof(sr_ethernet_hdr_t));
-  ipData->ip_ttl = 255;
-  ipData->ip_sum = 0;
-  ipData->ip_sum = (cksum(ipData, sizeof(sr_ip_hdr_t)));
+  ipData->ip_dst = origIP->ip_src;
+  ipData->ip_sum = cksum_fold(cksum_partial(&ipData->ip_dst, sizeof(ipData->ip_dst),
+                   cksum_partial(&ipData->ip_len, sizeof(ipData->ip_len), interfaceStruct->ip_tmpl_sum)));
+
+  uint8_t *icmpStart = (uint8_t*)ipData + sizeof(sr_ip_hdr_t);
+  unsigned int icmpLen = resDataLen - SR_IF_IP_LEN;
+  sr_icmp_hdr_t *icmpData = (sr_icmp_hdr_t*)icmpStart;
+  icmpData->icmp_type = icmp_type;
+  icmpData->icmp_code = icmp_code;
+  icmpData->icmp_sum = 0;
 
   if(icmp_type == TYPE_DST_UNREACHABLE)
   {
-    sr_icmp_t3_hdr_t *icmpData = (sr_icmp_t3_hdr_t*)((uint8_t*)ipData + sizeof(sr_ip_hdr_t));
-    icmpData->icmp_type = icmp_type;
-    icmpData->icmp_code = icmp_code;
-    memcpy(icmpData->data, (sr_ip_hdr_t*)(packet+sizeof(sr_ethernet_hdr_t)), ICMP_DATA_SIZE);
-    icmpData->icmp_sum = 0;
-    icmpData->icmp_sum = (cksum(icmpData, sizeof(sr_icmp_t3_hdr_t)));
+    sr_icmp_t3_hdr_t *t3Data = (sr_icmp_t3_hdr_t*)icmpStart;
+    t3Data->unused = 0;
+    t3Data->next_mtu = 0;
+    memcpy(t3Data->data, origIP, ICMP_DATA_SIZE);
   }
-  else
+  else if(icmp_type == TYPE_TIME_EXCEEDED)
   {
-    sr_icmp_hdr_t *icmpData = (sr_icmp_hdr_t*)((uint8_t*)ipData + sizeof(sr_ip_hdr_t));
-    icmpData->icmp_type = icmp_type;
-    icmpData->icmp_code = icmp_code;
+    uint8_t* unusedArea = icmpStart + sizeof(sr_icmp_hdr_t);
+    memset(unusedArea, 0, 4);
+    memcpy(unusedArea + 4, origIP, appendDataLen);
+  }
+  icmpData->icmp_sum = cksum(icmpStart, icmpLen);
 
-    if(icmp_type == TYPE_TIME_EXCEEDED)
-    {
-      uint32_t* unusedArea = (uint32_t*)(((uint8_t*)icmpData+sizeof(sr_icmp_hdr_t)));
-      *unusedArea = 0;
-      uint8_t* appenData = (uint8_t*)unusedArea + 4;
-      memcpy(appenData, (packet + sizeof(sr_ethernet_hdr_t)), appendDataLen);
-    }
-    icmpData->icmp_sum = 0;
-    icmpData->icmp_sum = (cksum(icmpData, sizeof(sr_icmp_hdr_t)));
-    
+  sr_send_packet_buf(sr, resData, resDataLen, interfaceStruct);
+}
 
-  }
-  
-  
-  sr_send_packet(sr, resData, resDataLen, interface);
-  free(resData);
-  return;
-  
-  
-  
+/*---------------------------------------------------------------------
+ * Method: generateICMP(..)
+ * Scope:  Global
+ *
+ * Sends an ICMP error about packet back to its source, unless the
+ * rate limits (sr_icmplim) suppress it; they are asked before anything
+ * is allocated.
+ *
+ *---------------------------------------------------------------------*/
+void generateICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interfaceStruct/* lent */, uint8_t icmp_type, uint8_t icmp_code)
+{
+  if(allowICMP(sr, packet, icmp_type))
+    buildICMP(sr, packet, len, interfaceStruct, icmp_type, icmp_code);
 }
 
-void handleTCP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */)
+/* ICMP errors for transit frames; with a control thread it builds them,
+   the limits are checked before the frame is copied for it */
+static void transitICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */, uint8_t icmp_type, uint8_t icmp_code)
 {
-  generateICMP(sr, packet, len, interface, TYPE_DST_UNREACHABLE, PORT_UNREACHABLE);
+  if(!sr->ctl)
+    generateICMP(sr, packet, len, interface, icmp_type, icmp_code);
+  else if(allowICMP(sr, packet, icmp_type))
+    sr_ctl_punt(sr, SR_CTL_IP, packet, len, interface, SR_CTL_ICMP(icmp_type, icmp_code));
 }
 
-void handleUDP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */)
+void handleTCP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */)
 {
   generateICMP(sr, packet, len, interface, TYPE_DST_UNREACHABLE, PORT_UNREACHABLE);
 }
 
-int calcMatchLevel( uint32_t addr1,  struct sr_rt* rt)
+void handleUDP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */)
 {
-  if(!rt) return 0;  
-
-  int matchLevel = 0;
-  
-  
-
-  addr1 = ntohl(addr1);
-  uint32_t rtNetAddr = ntohl(rt->dest.s_addr);
-  uint32_t rtNetMask = ntohl(rt->mask.s_addr);
-  uint32_t testbit = 1<<31;
-
-  while(rtNetMask & testbit)
-  {
-    if((rtNetAddr & testbit) != (addr1 & testbit))
-    {
-      matchLevel = 0;
-      break;
-    }
-    testbit >>=1;
-    matchLevel++;
-  }
-  /*
-  while(rtNetMask)
-  {
-    if((addr1&(uint8_t)(0x01)) != (rtNetAddr&(uint8_t)(0x01)))
-    {
-      matchLevel = 0;
-      break;
-    }
-
-    addr1 >>= 1;
-    rtNetAddr >>= 1;
-    rtNetMask >>= 1;
-    matchLevel++;
-  }*/
-
-  return matchLevel;
-
+  generateICMP(sr, packet, len, interface, TYPE_DST_UNREACHABLE, PORT_UNREACHABLE);
 }
 
-struct sr_rt* checkRoutingTable(struct sr_instance* sr, uint8_t * packet, unsigned int len)
+/* the calling worker's route cache, invalidated along with the router's,
+   or the router's own when no worker calls */
+static struct sr_rtcache* routeCache(struct sr_instance* sr)
 {
-  sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)((uint8_t*)packet + sizeof(sr_ethernet_hdr_t));
-  /*print_addr_ip_int(ntohl(ipData->ip_dst));
-  print_addr_ip_int(ntohl(sr->routing_table->next->dest.s_addr));*/
-
-  struct sr_rt* defaultRoute = NULL;
-
-  struct sr_rt* currRt = sr->routing_table;
+  struct sr_worker* w = sr_worker_self();
+  if(!w)
+    return &(sr->rtcache);
+  if(w->rtcache.route_gen != sr->rtcache.route_gen)
+    w->rtcache.route_gen = sr->rtcache.route_gen;
+  return &(w->rtcache);
+}
 
-  struct sr_rt* longgestMatch = NULL;
-  int maxMatchLevel = 0;
-  
+static int ensureFib(struct sr_instance* sr)
+{
+  if(!sr->fib)
+    sr->fib = sr_fib_build(sr->routing_table);
+  return sr->fib != NULL;
+}
 
-  while(currRt)
+/*---------------------------------------------------------------------
+ * Method: checkRoutingTableBulk(..)
+ * Scope:  Global
+ *
+ * Longest prefix match for the destinations of a burst of n packets;
+ * rts[i] receives the route for packets[i].  Recent answers come from
+ * the route cache.  The misses are looked up in the compiled fib
+ * together, so their memory accesses overlap, after it is rebuilt if
+ * the routing table changed since it was built, and are then cached.
+ *
+ *---------------------------------------------------------------------*/
+void checkRoutingTableBulk(struct sr_instance* sr, uint8_t ** packets, unsigned int n, struct sr_rt** rts)
+{
+  struct sr_rtcache* cache = routeCache(sr);
+  struct sr_rtcache_entry* cached;
+  uint32_t dst[SR_FIB_BULK_MAX];
+  struct sr_rt* found[SR_FIB_BULK_MAX];
+  unsigned int idx[SR_FIB_BULK_MAX];
+  unsigned int batch, i, numMiss;
+
+  while(n > 0)
   {
-    if(currRt->mask.s_addr == 0 && currRt->dest.s_addr == 0) defaultRoute = currRt;
+    batch = (n < SR_FIB_BULK_MAX) ? n : SR_FIB_BULK_MAX;
 
-    int tempMatchLevel = calcMatchLevel(ipData->ip_dst, currRt);
-    if(tempMatchLevel > maxMatchLevel)
+    numMiss = 0;
+    for(i = 0; i < batch; i++)
     {
-      maxMatchLevel = tempMatchLevel;
-      longgestMatch = currRt;
+      uint32_t ip = ((sr_ip_hdr_t*)(packets[i] + sizeof(sr_ethernet_hdr_t)))->ip_dst;
+      if((cached = sr_rtcache_lookup(cache, ip)) != NULL)
+        rts[i] = cached->rt;
+      else
+      {
+        dst[numMiss] = ip;
+        idx[numMiss++] = i;
+      }
     }
 
-    currRt = currRt->next;
-  }
+    if(numMiss && !ensureFib(sr))
+    {
+      for(i = 0; i < numMiss; i++)
+        rts[idx[i]] = NULL;
+    }
+    else if(numMiss)
+    {
+      sr_fib_lookup_bulk(sr->fib, dst, found, numMiss);
+      for(i = 0; i < numMiss; i++)
+      {
+        rts[idx[i]] = found[i];
+        sr_rtcache_insert(cache, dst[i], found[i]);
+      }
+    }
 
-  if(maxMatchLevel != 0)
-  {
-    return longgestMatch;
+    packets += batch;
+    rts += batch;
+    n -= batch;
   }
-  return defaultRoute;
 }
 
-void sendARPReuqest(struct sr_instance* sr, struct sr_packet *packetStruct, uint32_t ipAddr)
+/* dstMAC is NULL to broadcast the request, or the MAC to refresh */
+void sendARPReuqest(struct sr_instance* sr, int ifindex, uint32_t ipAddr, const uint8_t* dstMAC)
 {
-  if(!packetStruct)
-    return ;
-  struct sr_if* interface = sr_get_interface(sr, packetStruct->iface);
+  static const uint8_t broadcastAddr[ETHER_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  struct sr_if* interface = sr_get_interface_idx(sr, ifindex);
   if(!interface)
     return;
 
-  int dataLen = sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t);
-  uint8_t *resData = (uint8_t*)malloc(sizeof(uint8_t)* dataLen);
-
-  sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)resData;   
-  sr_arp_hdr_t * arpData = (sr_arp_hdr_t*)(resData+sizeof(sr_ethernet_hdr_t));
-
-  memcpy(ethData->ether_shost, interface->addr, ETHER_ADDR_LEN);
-  uint8_t broadcastAddr[ETHER_ADDR_LEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-  memcpy(ethData->ether_dhost, &broadcastAddr , ETHER_ADDR_LEN);
-  ethData->ether_type = htons(0x0806);
-
-  arpData->ar_hrd = htons(0x0001);
-  arpData->ar_pro = htons(0x0800);
-  arpData->ar_hln = 6;
-  arpData->ar_pln = 4;
-  arpData->ar_op = htons(0x01);
-
-  memcpy(arpData->ar_sha, interface->addr, ETHER_ADDR_LEN);
-  arpData->ar_sip = interface->ip;
-  memcpy(arpData->ar_tha, &broadcastAddr , ETHER_ADDR_LEN);
-  arpData->ar_tip = ipAddr;
-
-  sr_send_packet(sr, resData, dataLen, interface->name);
-
-  free(resData);
+  uint8_t *resData = sr_packet_alloc(SR_IF_ARP_LEN);
+  if(!resData)
+    return;
 
+  if(!dstMAC)
+    dstMAC = broadcastAddr;
+  buildARP(resData, interface, arp_op_request, dstMAC, dstMAC, ipAddr);
 
+  sr_send_packet_buf(sr, resData, SR_IF_ARP_LEN, interface);
 }
 
-void forwardPacket(struct sr_instance* sr, uint8_t * packet, unsigned int len, char* interface, struct sr_rt* rt)
+/* only the TTL changes, so patch the checksum instead of redoing it */
+static void decrementTTL(sr_ip_hdr_t *ipData)
 {
-  uint8_t *resData = (uint8_t*)malloc(sizeof(uint8_t)* len);
+  uint16_t oldWord, newWord;
+  memcpy(&oldWord, &ipData->ip_ttl, sizeof(oldWord));
+  ipData->ip_ttl -= 1;
+  memcpy(&newWord, &ipData->ip_ttl, sizeof(newWord));
+  ipData->ip_sum = cksum_update(ipData->ip_sum, oldWord, newWord);
+}
 
-  memcpy(resData, packet, len);
+/*---------------------------------------------------------------------
+ * Method: forwardPacket(..)
+ * Scope:  Global
+ *
+ * Rewrite the frame in place (TTL, checksum, Ethernet header) and hand
+ * it to sr_send_packet_if().  The frame is left untouched when an ICMP
+ * error is generated or it has to wait for ARP.
+ *
+ *---------------------------------------------------------------------*/
+void forwardPacket(struct sr_instance* sr, uint8_t * packet, unsigned int len, struct sr_if* interface, struct sr_rt* rt)
+{
+  struct sr_adj* adj = rt->adj;
+  if(!adj)
+    return;
 
-  struct sr_if* sourceInterface = sr_get_interface(sr, rt->interface);
-  if(!sourceInterface)
+  /* first packet to this next hop: fill in our side of the header */
+  if(adj->ifindex < 0)
   {
-    free(resData);
-    return;
+    struct sr_if* sourceInterface = sr_get_interface_idx(sr, rt->ifindex);
+    if(!sourceInterface)
+      return;
+    sr_adj_bind(adj, sourceInterface);
   }
 
-  sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)((uint8_t*)resData + sizeof(sr_ethernet_hdr_t));
-  ipData->ip_ttl -= 1;
-  if(ipData->ip_ttl == 0)
+  sr_ip_hdr_t *ipData = (sr_ip_hdr_t*)((uint8_t*)packet + sizeof(sr_ethernet_hdr_t));
+  if(ipData->ip_ttl <= 1)
   {
-    /* TTL == 0, drop the packet*/
-    generateICMP(sr, packet, len, interface, TYPE_TIME_EXCEEDED, CODE_TIME_EXCEEDED);
-    free(resData);
+    /* TTL would reach 0, drop the packet*/
+    transitICMP(sr, packet, len, interface, TYPE_TIME_EXCEEDED, CODE_TIME_EXCEEDED);
     return;
   }
 
-  struct sr_arpentry *arpLookUpResult = sr_arpcache_lookup(&(sr->cache), rt->gw.s_addr);
+  /* other workers may be rewriting the MAC, work on a copy */
+  uint8_t l2hdr[sizeof(sr_ethernet_hdr_t)];
+  unsigned int arpGen;
+  int arpHandle;
+  unsigned int gen = sr->cache.gen;
+  sr_adj_load(adj, l2hdr, &arpGen, &arpHandle);
 
-  if(!arpLookUpResult)
+  if(arpGen != gen || !arpHandle)
   {
-    ipData->ip_ttl += 1;
-    /*DONT do any edit in this packet, in case we need to send ICMP_UNREACHABLE to the origin */
-    struct sr_arpreq *arpReq = sr_arpcache_queuereq(&(sr->cache), rt->gw.s_addr, resData, len, rt->interface);
-
-    handle_arpReq(sr, arpReq);
-    free(resData);
-    return ;
-  }
-  
-  
-  sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t *)resData;    
+    struct sr_arpentry arpLookUpResult;
+    int handle = sr_arpcache_lookup(&(sr->cache), adj->gw, &arpLookUpResult);
 
-  memcpy(ethData->ether_shost, sourceInterface->addr, ETHER_ADDR_LEN);
-  
-  memcpy(ethData->ether_dhost, arpLookUpResult->mac, ETHER_ADDR_LEN);
-  free(arpLookUpResult);
-  
+    if(!handle)
+    {
+      /*DONT do any edit in this packet, in case we need to send ICMP_UNREACHABLE to the origin */
+      handle_arpMiss(sr, adj->gw, packet, len, adj->ifindex);
+      return ;
+    }
 
- 
-  ipData->ip_sum = 0;
-  ipData->ip_sum = (cksum(ipData, sizeof(sr_ip_hdr_t)));
+    sr_adj_set_mac(adj, arpLookUpResult.mac, gen, handle);
+    memcpy(l2hdr, arpLookUpResult.mac, ETHER_ADDR_LEN);
+  }
+  else
+  {
+    /* keeps the entry refreshed while traffic flows */
+    sr_arpcache_touch(&(sr->cache), arpHandle, adj->gw);
+  }
 
-  
-  sr_send_packet(sr, resData, len, rt->interface);
-  free(resData);
-  
+  decrementTTL(ipData);
+  memcpy(packet, l2hdr, sizeof(sr_ethernet_hdr_t));
 
+  sr_send_packet_if(sr, packet, len, sr_get_interface_idx(sr, adj->ifindex));
 }
 
-void handleARPResponse(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */)
+void handleARPResponse(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */)
 {
   sr_arp_hdr_t * arpData = (sr_arp_hdr_t*)(packet+sizeof(sr_ethernet_hdr_t));
 
-  struct sr_arpreq *req = sr_arpcache_insert(&(sr->cache), arpData->ar_sha, (arpData->ar_sip));
+  int handle;
+  unsigned int gen;
+  struct sr_arpreq *req = sr_arpcache_insert(&(sr->cache), arpData->ar_sha, (arpData->ar_sip), interface->index, &handle, &gen);
+
+  /* next hops behind this address can use the new mapping right away */
+  if(sr->fib)
+    sr_adjtab_update(&(sr->fib->adjtab), arpData->ar_sip, arpData->ar_sha, gen, handle);
   if(!req)
     return;
 
-  struct sr_packet *watingPacket = req->packets;
-  
+  /* queued packets already passed the TTL check and were routed to this
+     next hop, only the MAC was missing; send them in arrival order */
+  struct sr_packet *watingPacket;
+  for(watingPacket = req->packets; watingPacket; watingPacket = watingPacket->next)
+  {
+    struct sr_if* outInterface = sr_get_interface_idx(sr, watingPacket->ifindex);
+    if(!outInterface)
+      continue;
+
+    sr_ethernet_hdr_t *ethData = (sr_ethernet_hdr_t*)watingPacket->buf;
+    memcpy(ethData->ether_dhost, arpData->ar_sha, ETHER_ADDR_LEN);
+    memcpy(ethData->ether_shost, outInterface->addr, ETHER_ADDR_LEN);
+    ethData->ether_type = htons(ethertype_ip);
+    decrementTTL((sr_ip_hdr_t*)(watingPacket->buf + sizeof(sr_ethernet_hdr_t)));
+
+    sr_send_packet_if(sr, watingPacket->buf, watingPacket->len, outInterface);
+  }
+  sr_arpreq_destroy(&(sr->cache), req);
+
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_arp_preresolve(..)
+ * Scope:  Global
+ *
+ * Starts ARP for every gateway in the routing table, so the first
+ * packets towards them find the MAC already cached.  Called once the
+ * interfaces are known.
+ *
+ *---------------------------------------------------------------------*/
+void sr_arp_preresolve(struct sr_instance* sr)
+{
+  struct sr_rt* rt;
+  struct sr_arpentry entry;
 
-  while(watingPacket)
+  for(rt = sr->routing_table; rt; rt = rt->next)
   {
+    if(rt->gw.s_addr == 0 || rt->ifindex < 0)
+      continue;
+    if(sr_arpcache_lookup(&(sr->cache), rt->gw.s_addr, &entry))
+      continue;
+    /* a gateway already being resolved is left alone */
+    handle_arpMiss(sr, rt->gw.s_addr, NULL, 0, rt->ifindex);
+  }
+}
 
-    struct sr_rt* routingTableItem = checkRoutingTable(sr, watingPacket->buf, watingPacket->len);
-    if(routingTableItem != NULL)
+static void handleARP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */)
+{
+  uint8_t* senderMAC = extractSenderMAC(packet, len);
+  uint32_t senderIP = extractSenderIP(packet, len);
+  uint32_t targetIP = extractTargetIP(packet, len);
+
+  if(isARPRequest(packet, len))
+  {
+    struct sr_if* owner = sr_get_interface_by_ip(sr, targetIP);
+    if(owner)
     {
-      forwardPacket(sr, watingPacket->buf, watingPacket->len, watingPacket->iface, routingTableItem);
-      free(watingPacket->buf);
-      watingPacket->buf = NULL;
+      uint8_t *data = sr_packet_alloc(SR_IF_ARP_LEN);
+      if(!data)
+        return;
+      buildARP(data, owner, arp_op_reply, senderMAC, senderMAC, senderIP);
+      sr_send_packet_buf(sr, data, SR_IF_ARP_LEN, interface);
     }
-    
-    watingPacket = watingPacket->next;
-    
   }
-  sr_arpreq_destroy(&(sr->cache), req);
+  else{
+    /*get arp response*/
+    handleARPResponse(sr, packet, len, interface);
+  }
+}
 
+static void handleLocal(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */)
+{
+  int protocol = ip_protocol(packet+sizeof(sr_ethernet_hdr_t));
+  switch (protocol)
+  {
+      case 1:
+      {
+        handleIncomingICMP(sr, packet, len , interface);
+        break;
+      }
+      case 17:
+      {
+        handleUDP(sr, packet, len, interface);
+        break;
+      }
+      case 6:
+      {
+        handleTCP(sr, packet, len, interface);
+        break;
+      }
+      default:
+      {
+      }
+  }
+}
+
+static void handleTransit(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */, struct sr_rt* rt)
+{
+  /*forward to other*/
+  if(rt != NULL)
+  {
+    forwardPacket(sr, packet, len, interface, rt);
+  }
+  else
+  {
+    transitICMP(sr, packet, len, interface, TYPE_DST_UNREACHABLE, NET_UNREACHABLE);
+  }
+}
+
+/* with a control thread ARP requests and local traffic go there, the
+   forwarding thread keeps the ARP replies it may be waiting for */
+static int punt(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */, int arp)
+{
+  if(!sr->ctl)
+    return 0;
+  if(arp && !isARPRequest(packet, len))
+    return 0;
+  sr_ctl_punt(sr, arp ? SR_CTL_ARP : SR_CTL_IP, packet, len, interface, SR_CTL_LOCAL);
+  return 1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_control(..)
+ * Scope:  Global
+ *
+ * Runs on the control thread: answers a frame sr_ctl_punt() queued,
+ * of class cls and with tag as passed to it.
+ *
+ *---------------------------------------------------------------------*/
+void sr_handle_control(struct sr_instance* sr, unsigned int cls, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */, unsigned int tag)
+{
+  if(cls == SR_CTL_ARP)
+    handleARP(sr, packet, len, interface);
+  else if(tag == SR_CTL_LOCAL)
+    handleLocal(sr, packet, len, interface);
+  else
+    buildICMP(sr, packet, len, interface, (tag >> 8) & 0xff, tag & 0xff);
 }
 
 void sr_handlepacket(struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */)
+        char* name/* lent */)
 {
+  struct sr_if* interface;
+
   /* REQUIRES */
   assert(sr);
   assert(packet);
-  assert(interface);
+  assert(name);
+
+  /* resolved once here, everything below passes the record around */
+  interface = sr_get_interface(sr, name);
+  if(!interface)
+    return;
 
   /*printf("*** -> Received packet of length %d \n",len);*/
 
-  if(isARP(packet, len))
-  {
-    uint8_t* senderMAC = extractSenderMAC(packet, len);
-    uint32_t senderIP = extractSenderIP(packet, len);
-    uint8_t* targetMAC = extractTargetMAC(packet, len);
-    uint32_t targetIP = extractTargetIP(packet, len);
+  sr_handlepacket_burst(sr, &packet, &len, &interface, 1);
+}/* end sr_ForwardPacket */
 
-    if(isARPRequest(packet, len))
-    {
-      uint8_t* resultMAC = findMyMAC(sr, targetIP);
-      if(resultMAC)
-      {
-        uint8_t *data = (uint8_t*)malloc(sizeof(uint8_t)* (sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t)));
-        int dataLen = generateARPReply(data, senderMAC, senderIP, resultMAC, targetIP);
-        sr_send_packet(sr, data, dataLen, interface);
-        free(data);
-      }
-    }
-    else{
-      /*get arp response*/
-      handleARPResponse(sr, packet, len, interface);
-    }
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_burst(..)
+ * Scope:  Global
+ *
+ * Handles n frames received together, with their interfaces already
+ * resolved; sr_handlepacket() is the one-frame case.  The routes of all
+ * transit packets are looked up in one checkRoutingTableBulk() call,
+ * then the frames are handled in arrival order.
+ *
+ * With worker threads the reader only hands the frames over; the
+ * workers call this again to handle them.  With a control thread the
+ * frames that need an answer from the router are queued for it.
+ *
+ *---------------------------------------------------------------------*/
+void sr_handlepacket_burst(struct sr_instance* sr,
+        uint8_t ** packets/* lent */,
+        unsigned int * lens,
+        struct sr_if ** interfaces/* lent */,
+        unsigned int n)
+{
+  enum { PKT_DROP, PKT_ARP, PKT_LOCAL, PKT_TRANSIT } kind[SR_VNS_RX_BURST];
+  uint8_t* transit[SR_VNS_RX_BURST];
+  struct sr_rt* rts[SR_VNS_RX_BURST];
+  unsigned int batch, i, numTransit;
+
+  assert(sr);
 
-    free(senderMAC);
-    free(targetMAC);
+  if(sr->workers && !sr_worker_self())
+  {
+    sr_workers_dispatch(sr, packets, lens, interfaces, n);
+    return;
   }
-  else if(isValidIPPacket(packet, len))
+
+  while(n > 0)
   {
-    if(isForMe(sr, packet, len))
+    batch = (n < SR_VNS_RX_BURST) ? n : SR_VNS_RX_BURST;
+
+    /* classify first; nothing below changes what is local or routable */
+    numTransit = 0;
+    for(i = 0; i < batch; i++)
     {
-      int protocol = ip_protocol(packet+sizeof(sr_ethernet_hdr_t));
-      switch (protocol)
+      if(isARP(packets[i], lens[i]))
+        kind[i] = PKT_ARP;
+      else if(!isValidIPPacket(sr, packets[i], lens[i]))
+        kind[i] = PKT_DROP;
+      else if(isForMe(sr, packets[i], lens[i]))
+        kind[i] = PKT_LOCAL;
+      else
       {
-          case 1:
-          {
-            handleIncomingICMP(sr, packet, len , interface);
-            break;
-          }
-          case 17:
-          {
-            handleUDP(sr, packet, len, interface);
-            break;
-          }
-          case 6:
-          {
-            handleTCP(sr, packet, len, interface);
-            break;
-          }
-          default:
-          {
-          }
+        kind[i] = PKT_TRANSIT;
+        transit[numTransit++] = packets[i];
       }
-      
     }
-    else
+
+    if(numTransit)
+      checkRoutingTableBulk(sr, transit, numTransit, rts);
+
+    numTransit = 0;
+    for(i = 0; i < batch; i++)
     {
-      /*forward to other*/
-      struct sr_rt* routingTableItem = checkRoutingTable(sr, packet, len);
-      if(routingTableItem != NULL)
+      switch(kind[i])
       {
-        forwardPacket(sr, packet, len, interface, routingTableItem);
-      }
-      else
-      {
-        generateICMP(sr, packet, len, interface, TYPE_DST_UNREACHABLE, NET_UNREACHABLE);
+        case PKT_ARP:
+          if(!punt(sr, packets[i], lens[i], interfaces[i], 1))
+            handleARP(sr, packets[i], lens[i], interfaces[i]);
+          break;
+        case PKT_LOCAL:
+          if(!punt(sr, packets[i], lens[i], interfaces[i], 0))
+            handleLocal(sr, packets[i], lens[i], interfaces[i]);
+          break;
+        case PKT_TRANSIT:
+          handleTransit(sr, packets[i], lens[i], interfaces[i], rts[numTransit++]);
+          break;
+        default:
+          break;
       }
     }
-    
-  }
-  else
-  {
-    /*drop it*/
-    /*printf("unknown packet, drop.\n");*/
+
+    packets += batch;
+    lens += batch;
+    interfaces += batch;
+    n -= batch;
   }
 
-}/* end sr_ForwardPacket */
+  if(sr->ctl)
+    sr_ctl_kick(sr);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_dump_stats(..)
+ * Scope:  Global
+ *
+ * Prints the router's drop counters.
+ *
+ *---------------------------------------------------------------------*/
+void sr_dump_stats(struct sr_instance* sr)
+{
+  struct sr_mbuf_stats mbufs;
+  unsigned long syscalls, frames;
+  int i;
+
+  fprintf(stderr, "dropped IP packets:\n");
+  fprintf(stderr, "  too short %lu, bad header %lu, bad length %lu, bad checksum %lu\n",
+          sr->stats.ip_too_short, sr->stats.ip_bad_hdr,
+          sr->stats.ip_bad_len, sr->stats.ip_bad_cksum);
+  fprintf(stderr, "dropped while waiting on ARP:\n");
+  fprintf(stderr, "  request full %lu, queue full %lu, no request left %lu\n",
+          sr->cache.drops_req_cap, sr->cache.drops_queue_cap, sr->cache.drops_no_req);
+  fprintf(stderr, "ARP cache lock:\n");
+  fprintf(stderr, "  %lu holds, avg %lu us, max hold %lu us, max wait %lu us\n",
+          sr->cache.lock_holds,
+          sr->cache.lock_holds ? (unsigned long)(sr->cache.lock_hold_ns / sr->cache.lock_holds / 1000) : 0UL,
+          (unsigned long)(sr->cache.lock_hold_max_ns / 1000),
+          (unsigned long)(sr->cache.lock_wait_max_ns / 1000));
+
+  fprintf(stderr, "VNS receive:\n");
+  fprintf(stderr, "  %lu frames in %lu reads\n", sr->rx.frames, sr->rx.reads);
+  fprintf(stderr, "VNS transmit:\n");
+  fprintf(stderr, "  %lu frames in %lu writes, %lu flushes blocked\n",
+          sr->tx.frames, sr->tx.writes, sr->tx.blocked);
+  fprintf(stderr, "  queued %lu in their own buffer, %lu lent (%lu copied back), %lu copied\n",
+          sr->tx.given, sr->tx.lends, sr->tx.returned, sr->tx.copied);
+  for(i = 0; i < (int)sr->iftab.num; i++)
+    fprintf(stderr, "  %s: sent %lu, max depth %u, dropped %lu\n",
+            sr->iftab.ifs[i]->name, sr->tx.q[i].sent,
+            sr->tx.q[i].max_depth, sr->tx.q[i].drops);
+  if(sr->afp)
+    sr_afpacket_dump_stats(sr);
+  if(sr->workers)
+    sr_workers_dump_stats(sr);
+  if(sr->writer)
+    sr_writer_dump_stats(sr);
+  if(sr->ctl)
+    sr_ctl_dump_stats(sr);
+  if(sr->pcaplog)
+    sr_pcaplog_dump_stats(sr);
+  sr_icmplim_dump_stats(&(sr->icmplim));
+  sr_busypoll_dump_stats(&(sr->busy));
+  syscalls = sr->rx.syscalls + sr->tx.syscalls + sr_uring_syscalls(sr->tx.uring);
+  frames = sr->rx.frames + sr->tx.frames;
+  fprintf(stderr, "VNS syscalls (%s):\n", sr->tx.uring ? "io_uring" : "epoll");
+  fprintf(stderr, "  %lu, %.3f per frame\n", syscalls,
+          frames ? (double)syscalls / frames : 0.0);
+
+  sr_mbuf_get_stats(&mbufs);
+  fprintf(stderr, "packet buffers:\n");
+  fprintf(stderr, "  %u of %u in pool, %lu refills, exhausted %lu, oversize %lu\n",
+          mbufs.available, mbufs.count, mbufs.refills,
+          mbufs.exhausted, mbufs.oversize);
+}
 
@@ -11,12 +11,18 @@
 
 #include <netinet/in.h>
 #include <sys/time.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "sr_protocol.h"
+#include "vnscommand.h"
 #include "sr_arpcache.h"
+#include "sr_rtcache.h"
+#include "sr_txq.h"
+#include "sr_busypoll.h"
+#include "sr_icmplim.h"
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
@@ -32,6 +38,13 @@
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
 
+/* Bytes kept free in front of every frame handed to sr_handlepacket() or
+   allocated with sr_packet_alloc(), room for a VNS header. */
+#define SR_PACKET_HEADROOM (sizeof(c_packet_header))
+
+#define SR_VNS_RX_SIZE  (256 * 1024) /* receive buffer, many VNS commands */
+#define SR_VNS_RX_BURST 32           /* frames per sr_handlepacket_burst() */
+
 #define TYPE_TIME_EXCEEDED 11
 #define CODE_TIME_EXCEEDED 0
 #define TYPE_DST_UNREACHABLE 3
@@ -39,9 +52,50 @@
 #define NET_UNREACHABLE 0
 #define HOST_UNREACHABLE 1
 
+/* ----------------------------------------------------------------------------
+ * struct sr_router_stats
+ *
+ * Packets dropped by the router, by reason.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_router_stats
+{
+    unsigned long ip_too_short;   /* frame shorter than the headers */
+    unsigned long ip_bad_hdr;     /* version or header length wrong */
+    unsigned long ip_bad_len;     /* total length inconsistent */
+    unsigned long ip_bad_cksum;   /* header checksum wrong */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vns_rx
+ *
+ * Bytes read from the VNS socket.  Complete commands are parsed from
+ * head, the next recv() appends at tail.  A partial command left at the
+ * end is moved to the front before reading again.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_vns_rx
+{
+    uint8_t* buf;                 /* SR_VNS_RX_SIZE bytes */
+    unsigned int head;
+    unsigned int tail;
+    unsigned long reads;          /* recv() calls that returned data */
+    unsigned long syscalls;       /* recv() calls */
+    uint64_t stamp;               /* last read's bytes arrived, monotonic ns */
+    unsigned long frames;         /* frames received, on any path */
+};
+
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_afpacket;
+struct sr_fib;
+struct sr_workers;
+struct sr_writer;
+struct sr_ctl;
+struct sr_pcaplog;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -59,10 +113,26 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_iftab iftab; /* if_list by index, name, IP and MAC */
     struct sr_rt* routing_table; /* routing table */
+    struct sr_fib* fib; /* compiled from routing_table, 0 when stale */
     struct sr_arpcache cache;   /* ARP cache */
+    unsigned int arpcache_size; /* entries the ARP cache is created with */
+    struct sr_rtcache rtcache;  /* recent forwarding decisions */
     pthread_attr_t attr;
     FILE* logfile;
+    struct sr_pcaplog* pcaplog; /* -l: thread writing logfile, or 0 */
+    struct sr_router_stats stats;
+    struct sr_vns_rx rx; /* receive buffer of sockfd */
+    struct sr_tx tx;     /* transmit queues of sockfd */
+    int use_uring;       /* -U: drive sockfd through io_uring */
+    struct sr_afpacket* afp; /* -i: real interfaces in place of sockfd, or 0 */
+    struct sr_busypoll busy; /* -B: busy polling, and forwarding latency */
+    struct sr_workers* workers; /* -w: forwarding threads, or 0 */
+    struct sr_writer* writer;   /* -P: thread sending for the workers, or 0 */
+    struct sr_ctl* ctl;         /* -S: control thread for ARP and ICMP, or 0 */
+    struct sr_icmplim icmplim;  /* -I: limits on generated ICMP errors */
+    volatile sig_atomic_t quit; /* SIGINT: the main loop returns */
 };
 
 /* -- sr_main.c -- */
@@ -70,18 +140,28 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_if(struct sr_instance* , uint8_t* , unsigned int , const struct sr_if*);
+int sr_send_packet_buf(struct sr_instance* , uint8_t* , unsigned int , const struct sr_if*);
+uint8_t* sr_packet_alloc(unsigned int len);
+void sr_packet_free(uint8_t* buf);
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+void sr_rx_frame(struct sr_instance* , uint8_t* , unsigned int , struct sr_if* ,
+                 uint8_t** , unsigned int* , struct sr_if** , unsigned int* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
-void generateICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, char* interface/* lent */, uint8_t icmp_type, uint8_t icmp_code);
-struct sr_rt* checkRoutingTable(struct sr_instance* sr, uint8_t * packet, unsigned int len);
-void sendARPReuqest(struct sr_instance* sr, struct sr_packet *packetStruct, uint32_t ipAddr);
+void sr_handlepacket_burst(struct sr_instance* , uint8_t ** , unsigned int * , struct sr_if ** , unsigned int );
+void sr_dump_stats(struct sr_instance* );
+void sr_handle_control(struct sr_instance* sr, unsigned int cls, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */, unsigned int tag);
+void generateICMP(struct sr_instance* sr, uint8_t * packet/* lent */, unsigned int len, struct sr_if* interface/* lent */, uint8_t icmp_type, uint8_t icmp_code);
+void checkRoutingTableBulk(struct sr_instance* sr, uint8_t ** packets, unsigned int n, struct sr_rt** rts);
+void sendARPReuqest(struct sr_instance* sr, int ifindex, uint32_t ipAddr, const uint8_t* dstMAC);
+void sr_arp_preresolve(struct sr_instance* sr);
 
 /* -- sr_if.c -- */
-void sr_add_interface(struct sr_instance* , const char* );
+int sr_add_interface(struct sr_instance* , const char* );
 void sr_set_ether_ip(struct sr_instance* , uint32_t );
 void sr_set_ether_addr(struct sr_instance* , const unsigned char* );
 void sr_print_if_list(struct sr_instance* );
@@ -21,6 +21,7 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_fib.h"
 
 /*---------------------------------------------------------------------
  * Method:
@@ -28,6 +29,9 @@
  *---------------------------------------------------------------------*/
 void sr_destory_rt(struct sr_instance* sr){
     struct sr_rt* next;
+    sr_fib_destroy(sr->fib);
+    sr->fib = 0;
+    sr_rtcache_flush_routes(&(sr->rtcache));
     while (sr->routing_table){
         printf("freeing previous routing table %lu\n", sizeof(*(sr->routing_table)));
 	next = sr->routing_table->next;
@@ -93,9 +97,24 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
     } /* -- while -- */
     fclose(fp);
+
+    if((sr->fib = sr_fib_build(sr->routing_table)) == 0)
+    {
+        fprintf(stderr, "Error compiling routing table %s\n", filename);
+        return -1;
+    }
+    /* -- the interfaces may be known already -- */
+    sr_rt_bind_interfaces(sr);
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
+static int sr_rt_ifindex(struct sr_instance* sr, const char* if_name)
+{
+    struct sr_if* iface = sr_get_interface(sr, if_name);
+
+    return iface ? iface->index : -1;
+} /* -- sr_rt_ifindex -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
@@ -110,6 +129,11 @@ struct in_addr gw, struct in_addr mask,char* if_name)
     assert(if_name);
     assert(sr);
 
+    /* -- compiled table no longer matches the list -- */
+    sr_fib_destroy(sr->fib);
+    sr->fib = 0;
+    sr_rtcache_flush_routes(&(sr->rtcache));
+
     /* -- empty list special case -- */
     if(sr->routing_table == 0)
     {
@@ -119,7 +143,9 @@ struct in_addr gw, struct in_addr mask,char* if_name)
         sr->routing_table->dest = dest;
         sr->routing_table->gw   = gw;
         sr->routing_table->mask = mask;
+        sr->routing_table->adj  = 0;
         strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+        sr->routing_table->ifindex = sr_rt_ifindex(sr, if_name);
 
         return;
     }
@@ -138,10 +164,40 @@ struct in_addr gw, struct in_addr mask,char* if_name)
     rt_walker->dest = dest;
     rt_walker->gw   = gw;
     rt_walker->mask = mask;
+    rt_walker->adj  = 0;
     strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+    rt_walker->ifindex = sr_rt_ifindex(sr, if_name);
 
 } /* -- sr_add_entry -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_bind_interfaces(..)
+ * Scope:  Global
+ *
+ * Resolves every route's interface name to its index.  The routing
+ * table is loaded before VNSHWINFO tells us the interfaces, so this
+ * runs again once they are known.  The fib's next hops are bound here
+ * too, before any frame is forwarded, so forwarding workers never
+ * write that half of an adjacency.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_bind_interfaces(struct sr_instance* sr)
+{
+    struct sr_rt* rt;
+    struct sr_if* iface;
+    unsigned int i;
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    { rt->ifindex = sr_rt_ifindex(sr, rt->interface); }
+
+    for(i = 0; sr->fib && i < sr->fib->adjtab.num; i++)
+    {
+        if((iface = sr_get_interface(sr, sr->fib->adjtab.adjs[i].iface)) != 0)
+        { sr_adj_bind(&(sr->fib->adjtab.adjs[i]), iface); }
+    }
+} /* -- sr_rt_bind_interfaces -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
@@ -20,6 +20,8 @@
 
 #include "sr_if.h"
 
+struct sr_adj;
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
@@ -33,6 +35,8 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
+    int    ifindex;    /* into sr->iftab, -1 until interfaces are known */
+    struct sr_adj* adj; /* next hop, set while the fib is built */
     struct sr_rt* next;
 };
 
@@ -40,6 +44,7 @@ void sr_destory_rt(struct sr_instance*);
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, char*);
+void sr_rt_bind_interfaces(struct sr_instance*);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
@@ -0,0 +1,109 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rtcache.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Destination route cache in front of the fib.  See sr_rtcache.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_rtcache.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_rtcache_set(..)
+ * Scope:  Local
+ *
+ * Fibonacci hash of the destination onto a set.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rtcache_entry* sr_rtcache_set(struct sr_rtcache* cache,
+                                               uint32_t ip)
+{
+    uint32_t h = ip * 2654435769u;
+    return cache->sets[(h >> 24) & (SR_RTCACHE_SETS - 1)];
+} /* -- sr_rtcache_set -- */
+
+static struct sr_rtcache_entry* sr_rtcache_find(struct sr_rtcache* cache,
+                                                uint32_t ip)
+{
+    struct sr_rtcache_entry* set = sr_rtcache_set(cache, ip);
+    unsigned int gen = cache->route_gen;
+    int i;
+
+    for(i = 0; i < SR_RTCACHE_WAYS; i++)
+    {
+        if(set[i].route_gen == gen && set[i].ip == ip)
+        { return &set[i]; }
+    }
+    return 0;
+} /* -- sr_rtcache_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rtcache_init(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rtcache_init(struct sr_rtcache* cache)
+{
+    /* -- REQUIRES -- */
+    assert(cache);
+
+    memset(cache, 0, sizeof(struct sr_rtcache));
+
+    /* -- zeroed entries carry generation 0, so start at 1 -- */
+    cache->route_gen = 1;
+} /* -- sr_rtcache_init -- */
+
+struct sr_rtcache_entry* sr_rtcache_lookup(struct sr_rtcache* cache,
+                                           uint32_t ip)
+{
+    struct sr_rtcache_entry* entry = sr_rtcache_find(cache, ip);
+
+    if(entry)
+    { cache->hits++; }
+    else
+    { cache->misses++; }
+
+    return entry;
+} /* -- sr_rtcache_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rtcache_insert(..)
+ * Scope:  Global
+ *
+ * New entries go into way 0; the previous way 0 entry is pushed down
+ * and the oldest one falls out.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rtcache_insert(struct sr_rtcache* cache, uint32_t ip,
+                       struct sr_rt* rt)
+{
+    struct sr_rtcache_entry* set = sr_rtcache_set(cache, ip);
+
+    memmove(&set[1], &set[0],
+            (SR_RTCACHE_WAYS - 1) * sizeof(struct sr_rtcache_entry));
+
+    set[0].ip = ip;
+    set[0].route_gen = cache->route_gen;
+    set[0].rt = rt;
+} /* -- sr_rtcache_insert -- */
+
+void sr_rtcache_flush_routes(struct sr_rtcache* cache)
+{
+    __sync_fetch_and_add(&cache->route_gen, 1);
+} /* -- sr_rtcache_flush_routes -- */
+
+void sr_rtcache_dump(struct sr_rtcache* cache)
+{
+    fprintf(stderr, "route cache: %d sets x %d ways\n",
+            SR_RTCACHE_SETS, SR_RTCACHE_WAYS);
+    fprintf(stderr, "  hits %lu misses %lu\n", cache->hits, cache->misses);
+} /* -- sr_rtcache_dump -- */
@@ -0,0 +1,64 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rtcache.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Small set-associative cache of recent forwarding decisions keyed by
+ * destination IP.  Each entry remembers the route picked by the fib;
+ * the route's adjacency carries the next hop MAC, so packets of a
+ * long-lived flow skip both the LPM and the ARP cache.
+ *
+ * Entries are invalidated in bulk by bumping route_gen whenever the
+ * routing table is reloaded.  Only the forwarding thread reads or fills
+ * entries, each worker has a cache of its own that follows the router's
+ * route_gen; sr_rtcache_flush_routes() is safe from any thread.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_RTCACHE_H
+#define SR_RTCACHE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_RTCACHE_SETS 256  /* power of two */
+#define SR_RTCACHE_WAYS 2
+
+struct sr_rt;
+
+struct sr_rtcache_entry
+{
+    uint32_t ip;                /* destination, network byte order */
+    unsigned int route_gen;     /* entry valid while equal to cache's */
+    struct sr_rt* rt;
+};
+
+struct sr_rtcache
+{
+    struct sr_rtcache_entry sets[SR_RTCACHE_SETS][SR_RTCACHE_WAYS];
+    volatile unsigned int route_gen;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+void sr_rtcache_init(struct sr_rtcache* cache);
+
+/* Returns the cached route entry for ip or 0 on a miss.  The returned
+   entry's rt may itself be 0 (no route). */
+struct sr_rtcache_entry* sr_rtcache_lookup(struct sr_rtcache* cache,
+                                           uint32_t ip);
+void sr_rtcache_insert(struct sr_rtcache* cache, uint32_t ip,
+                       struct sr_rt* rt);
+
+void sr_rtcache_flush_routes(struct sr_rtcache* cache);
+
+/* Prints hit/miss counters. */
+void sr_rtcache_dump(struct sr_rtcache* cache);
+
+#endif /* -- SR_RTCACHE_H -- */
@@ -0,0 +1,197 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Hierarchical timer wheel and cached monotonic clock.  See sr_timer.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <time.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sr_timer.h"
+
+#define SR_TIMER_MASK  (SR_TIMER_SLOTS - 1)
+#define SR_TIMER_RANGE ((uint64_t)1 << (SR_TIMER_BITS * SR_TIMER_LEVELS))
+
+static volatile uint64_t sr_clock_cached = 0;
+
+/*---------------------------------------------------------------------
+ * Method: sr_clock_update(..)
+ * Scope:  Global
+ *
+ * Reads the monotonic clock into the cache.  A 64-bit store is single
+ * copy atomic on the hosts we build for, so readers need no lock.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_clock_update(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sr_clock_cached = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} /* -- sr_clock_update -- */
+
+uint64_t sr_clock_ms(void)
+{
+    if(sr_clock_cached == 0)
+    { sr_clock_update(); }
+    return sr_clock_cached;
+} /* -- sr_clock_ms -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_enqueue(..)
+ * Scope:  Local
+ *
+ * Links timer into the slot that covers its deadline: level 0 when it
+ * is due within SR_TIMER_SLOTS ticks, otherwise the lowest level whose
+ * span reaches it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_timer_enqueue(struct sr_timerwheel* wheel,
+                             struct sr_timer* timer)
+{
+    uint64_t delta;
+    struct sr_timer** head;
+    int level = 0;
+
+    if(timer->expires < wheel->tick)
+    { timer->expires = wheel->tick; }
+    delta = timer->expires - wheel->tick;
+    if(delta >= SR_TIMER_RANGE)
+    {
+        timer->expires = wheel->tick + SR_TIMER_RANGE - 1;
+        delta = SR_TIMER_RANGE - 1;
+    }
+
+    while(delta >= ((uint64_t)1 << (SR_TIMER_BITS * (level + 1))))
+    { level++; }
+
+    head = &(wheel->slots[level][(timer->expires >> (SR_TIMER_BITS * level))
+                                  & SR_TIMER_MASK]);
+    timer->next = *head;
+    if(*head)
+    { (*head)->pprev = &(timer->next); }
+    *head = timer;
+    timer->pprev = head;
+} /* -- sr_timer_enqueue -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timerwheel_cascade(..)
+ * Scope:  Local
+ *
+ * Moves the timers of one slot of a higher level down to where they
+ * belong now that the wheel has advanced.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_timerwheel_cascade(struct sr_timerwheel* wheel, int level,
+                                  unsigned int index)
+{
+    struct sr_timer* timer = wheel->slots[level][index];
+    struct sr_timer* next;
+
+    wheel->slots[level][index] = 0;
+    for(; timer; timer = next)
+    {
+        next = timer->next;
+        sr_timer_enqueue(wheel, timer);
+    }
+} /* -- sr_timerwheel_cascade -- */
+
+void sr_timerwheel_init(struct sr_timerwheel* wheel)
+{
+    assert(wheel);
+
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    sr_clock_update();
+    wheel->tick = sr_clock_ms() / SR_TIMER_TICK_MS;
+} /* -- sr_timerwheel_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timerwheel_run(..)
+ * Scope:  Global
+ *
+ * Processes every tick up to the cached clock.  Each due timer is
+ * unlinked before its callback runs, so the callback may re-arm it or
+ * free the object that embeds it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timerwheel_run(struct sr_timerwheel* wheel, void* ctx)
+{
+    uint64_t now = sr_clock_ms() / SR_TIMER_TICK_MS;
+    struct sr_timer* timer;
+    unsigned int index;
+    int level;
+
+    while(wheel->tick <= now)
+    {
+        index = wheel->tick & SR_TIMER_MASK;
+
+        /* level 0 wrapped: pull the next slot of each level above down */
+        if(index == 0)
+        {
+            for(level = 1; level < SR_TIMER_LEVELS; level++)
+            {
+                unsigned int upper = (wheel->tick >> (SR_TIMER_BITS * level))
+                                     & SR_TIMER_MASK;
+                sr_timerwheel_cascade(wheel, level, upper);
+                if(upper != 0)
+                { break; }
+            }
+        }
+
+        while((timer = wheel->slots[0][index]) != 0)
+        {
+            sr_timer_del(timer);
+            timer->fn(timer, ctx);
+        }
+
+        wheel->tick++;
+    }
+} /* -- sr_timerwheel_run -- */
+
+void sr_timer_init(struct sr_timer* timer, sr_timer_fn fn, void* arg)
+{
+    timer->next = 0;
+    timer->pprev = 0;
+    timer->expires = 0;
+    timer->fn = fn;
+    timer->arg = arg;
+} /* -- sr_timer_init -- */
+
+void sr_timer_add(struct sr_timerwheel* wheel, struct sr_timer* timer,
+                  unsigned int delay_ms)
+{
+    if(timer->pprev)
+    { sr_timer_del(timer); }
+
+    timer->expires = (sr_clock_ms() + delay_ms + SR_TIMER_TICK_MS - 1)
+                     / SR_TIMER_TICK_MS;
+    /* never into the slot being run, or a zero delay would spin */
+    if(timer->expires <= wheel->tick)
+    { timer->expires = wheel->tick + 1; }
+
+    sr_timer_enqueue(wheel, timer);
+} /* -- sr_timer_add -- */
+
+void sr_timer_del(struct sr_timer* timer)
+{
+    if(!timer->pprev)
+    { return; }
+
+    *(timer->pprev) = timer->next;
+    if(timer->next)
+    { timer->next->pprev = timer->pprev; }
+    timer->next = 0;
+    timer->pprev = 0;
+} /* -- sr_timer_del -- */
+
+int sr_timer_pending(const struct sr_timer* timer)
+{ return timer->pprev != 0; }
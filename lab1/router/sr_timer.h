@@ -0,0 +1,80 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Hierarchical timer wheel and a cached monotonic clock.
+ *
+ * The wheel has SR_TIMER_LEVELS levels of SR_TIMER_SLOTS slots each.
+ * Level 0 covers the next SR_TIMER_SLOTS ticks one slot per tick; every
+ * further level covers SR_TIMER_SLOTS times the span of the one below
+ * and is cascaded down when the lower level wraps.  Adding, deleting
+ * and firing a timer are all O(1).
+ *
+ * The wheel does no locking of its own; its owner serializes every call
+ * (the ARP cache uses its lock).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TIMER_H
+#define SR_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TIMER_TICK_MS 10
+#define SR_TIMER_BITS    6
+#define SR_TIMER_SLOTS   (1 << SR_TIMER_BITS)
+#define SR_TIMER_LEVELS  4     /* 2^24 ticks, about 46 hours */
+
+struct sr_timer;
+
+/* ctx is whatever the caller handed to sr_timerwheel_run() */
+typedef void (*sr_timer_fn)(struct sr_timer* timer, void* ctx);
+
+/* ----------------------------------------------------------------------------
+ * struct sr_timer
+ *
+ * Embedded in the object it times.  pprev is 0 while the timer is not
+ * pending.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_timer
+{
+    struct sr_timer* next;
+    struct sr_timer** pprev;
+    uint64_t expires;           /* tick */
+    sr_timer_fn fn;
+    void* arg;
+};
+
+struct sr_timerwheel
+{
+    struct sr_timer* slots[SR_TIMER_LEVELS][SR_TIMER_SLOTS];
+    uint64_t tick;              /* next tick to run */
+};
+
+/* Refreshes the cached clock; call once per loop iteration. */
+void sr_clock_update(void);
+/* Milliseconds since an arbitrary start, as of the last update. */
+uint64_t sr_clock_ms(void);
+
+void sr_timerwheel_init(struct sr_timerwheel* wheel);
+/* Fires every timer whose deadline is at or before sr_clock_ms(). */
+void sr_timerwheel_run(struct sr_timerwheel* wheel, void* ctx);
+
+void sr_timer_init(struct sr_timer* timer, sr_timer_fn fn, void* arg);
+/* (Re)arms timer to fire delay_ms from now. */
+void sr_timer_add(struct sr_timerwheel* wheel, struct sr_timer* timer,
+                  unsigned int delay_ms);
+void sr_timer_del(struct sr_timer* timer);
+int  sr_timer_pending(const struct sr_timer* timer);
+
+#endif /* -- SR_TIMER_H -- */
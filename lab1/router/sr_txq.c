@@ -0,0 +1,604 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_txq.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Per-interface transmit queues for the VNS connection.  See sr_txq.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+#include "sr_txq.h"
+#include "sr_mbuf.h"
+#include "sr_uring.h"
+#include "sr_busypoll.h"
+#include "sr_ring.h"
+#include "vnscommand.h"
+
+void sr_tx_init(struct sr_tx* tx)
+{
+    memset(tx, 0, sizeof(*tx));
+    tx->fd = -1;
+    tx->epfd = -1;
+    tx->partial_q = -1;
+    pthread_mutex_init(&(tx->lock), 0);
+} /* -- sr_tx_init -- */
+
+void sr_tx_destroy(struct sr_tx* tx)
+{
+    unsigned int i;
+
+    /* -- no send may still point into the queued buffers -- */
+    sr_uring_destroy(tx->uring);
+    tx->uring = 0;
+
+    for(i = 0; i < SR_IF_MAX; i++)
+    {
+        struct sr_txq* q = &(tx->q[i]);
+
+        for(; q->num > 0; q->num--)
+        {
+            if(!q->ring[q->head].lent)
+            { sr_mbuf_put(q->ring[q->head].buf); }
+            q->head = (q->head + 1) % SR_TXQ_LEN;
+        }
+    }
+    if(tx->epfd >= 0)
+    { close(tx->epfd); }
+    pthread_mutex_destroy(&(tx->lock));
+} /* -- sr_tx_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_attach(..)
+ * Scope:  Global
+ *
+ * With use_uring set tries to hand the socket to io_uring first.  The
+ * socket then stays blocking, io_uring waits for it by itself.
+ * Otherwise, or if io_uring is unavailable, switches the socket to
+ * non-blocking mode and, unless bp busy polls, puts it into an epoll
+ * set.  Until then frames are written with blocking writes.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_attach(struct sr_tx* tx, int fd, int use_uring,
+                 struct sr_busypoll* bp)
+{
+    struct epoll_event ev;
+    int flags;
+
+    if(use_uring)
+    {
+        pthread_mutex_lock(&(tx->lock));
+        if((tx->uring = sr_uring_create(fd, tx, bp)) != 0)
+        { tx->fd = fd; }
+        pthread_mutex_unlock(&(tx->lock));
+        if(tx->uring)
+        { return 0; }
+        fprintf(stderr, "io_uring unavailable, using epoll\n");
+    }
+
+    if((flags = fcntl(fd, F_GETFL, 0)) < 0 ||
+       fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        perror("fcntl(..):sr_txq.c::sr_tx_attach");
+        return -1;
+    }
+
+    /* -- a busy polling reader writes whenever it polls -- */
+    if(bp->idle_us)
+    {
+        pthread_mutex_lock(&(tx->lock));
+        tx->fd = fd;
+        pthread_mutex_unlock(&(tx->lock));
+        return 0;
+    }
+
+    if((tx->epfd = epoll_create(1)) < 0)
+    {
+        perror("epoll_create(..):sr_txq.c::sr_tx_attach");
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    tx->syscalls++;
+    if(epoll_ctl(tx->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl(..):sr_txq.c::sr_tx_attach");
+        close(tx->epfd);
+        tx->epfd = -1;
+        return -1;
+    }
+
+    pthread_mutex_lock(&(tx->lock));
+    tx->fd = fd;
+    pthread_mutex_unlock(&(tx->lock));
+    return 0;
+} /* -- sr_tx_attach -- */
+
+/* asks epoll to report writability only while something is queued */
+static void sr_tx_arm(struct sr_tx* tx, int out)
+{
+    struct epoll_event ev;
+
+    /* -- the writer thread waits for room by itself -- */
+    if(tx->epfd < 0 || tx->out_armed == out || tx->kick)
+    { return; }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (out ? EPOLLOUT : 0);
+    ev.data.fd = tx->fd;
+    tx->syscalls++;
+    if(epoll_ctl(tx->epfd, EPOLL_CTL_MOD, tx->fd, &ev) == 0)
+    { tx->out_armed = out; }
+} /* -- sr_tx_arm -- */
+
+static void sr_tx_pop(struct sr_tx* tx, int index)
+{
+    struct sr_txq* q = &(tx->q[index]);
+    struct sr_txframe* f = &(q->ring[q->head]);
+
+    if(f->lent)
+    { tx->lent--; }
+    else
+    { sr_mbuf_put(f->buf); }
+    q->head = (q->head + 1) % SR_TXQ_LEN;
+    q->num--;
+    q->sent++;
+    tx->queued--;
+    tx->frames++;
+} /* -- sr_tx_pop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_gather(..)
+ * Scope:  Local
+ *
+ * Fills tx->iov with up to SR_TX_IOV_MAX frames, the rest of a half
+ * written one first and then one frame per queue in turn.  Nothing is
+ * taken off the queues yet.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_tx_gather(struct sr_tx* tx)
+{
+    unsigned int taken[SR_IF_MAX];
+    unsigned int n = 0, q, idle;
+
+    memset(taken, 0, sizeof(taken));
+
+    /* -- the VNS stream must not interleave frames -- */
+    if(tx->partial_q >= 0)
+    {
+        struct sr_txq* pq = &(tx->q[tx->partial_q]);
+        struct sr_txframe* f = &(pq->ring[pq->head]);
+
+        tx->iov[0].iov_base = f->buf + tx->partial_off;
+        tx->iov[0].iov_len = f->len - tx->partial_off;
+        tx->owner[0] = tx->partial_q;
+        taken[tx->partial_q] = 1;
+        n = 1;
+    }
+
+    for(q = tx->next_q, idle = 0; n < SR_TX_IOV_MAX && idle < SR_IF_MAX;
+        q = (q + 1) % SR_IF_MAX)
+    {
+        struct sr_txq* txq = &(tx->q[q]);
+        struct sr_txframe* f;
+
+        if(taken[q] >= txq->num)
+        {
+            idle++;
+            continue;
+        }
+        f = &(txq->ring[(txq->head + taken[q]) % SR_TXQ_LEN]);
+        tx->iov[n].iov_base = f->buf;
+        tx->iov[n].iov_len = f->len;
+        tx->owner[n++] = q;
+        taken[q]++;
+        idle = 0;
+    }
+    tx->next_q = q;
+    tx->niov = n;
+
+    return n;
+} /* -- sr_tx_gather -- */
+
+/* retires the frames the first ret bytes of tx->iov completed and
+   remembers where a short write stopped; returns 1 if it was short */
+static int sr_tx_retire(struct sr_tx* tx, size_t ret)
+{
+    unsigned int i, n = tx->niov;
+
+    tx->writes++;
+    tx->niov = 0;
+    for(i = 0; i < n; i++)
+    {
+        if(ret < tx->iov[i].iov_len)
+        {
+            if(tx->partial_q < 0)
+            { tx->partial_off = 0; }
+            tx->partial_q = tx->owner[i];
+            tx->partial_off += ret;
+            break;
+        }
+        ret -= tx->iov[i].iov_len;
+        sr_tx_pop(tx, tx->owner[i]);
+        tx->partial_q = -1;
+        tx->partial_off = 0;
+    }
+
+    if(i < n)
+    {
+        tx->blocked++;
+        return 1;
+    }
+    return 0;
+} /* -- sr_tx_retire -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_flush_locked(..)
+ * Scope:  Local
+ *
+ * Writes gathered frames with one writev() at a time until the queues
+ * are empty or the socket is full.  Under io_uring retires the send in
+ * flight if it has completed and submits the next batch.  With a
+ * writer thread any other caller only wakes it.  Caller holds the tx
+ * lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tx_flush_locked(struct sr_tx* tx)
+{
+    ssize_t ret;
+
+    if(tx->kick && !pthread_equal(pthread_self(), tx->writer))
+    {
+        sr_bell_ring(tx->kick);
+        return 0;
+    }
+
+    if(tx->uring)
+    {
+        int res;
+
+        if(tx->inflight)
+        {
+            if(!sr_uring_send_done(tx->uring, &res))
+            { return 0; }
+            tx->inflight = 0;
+            if(res < 0)
+            {
+                /* -- nothing went out, the batch is gathered again -- */
+                errno = -res;
+                perror("sendmsg(..):sr_txq.c::sr_tx_flush");
+                tx->niov = 0;
+                return -1;
+            }
+            sr_tx_retire(tx, res);
+        }
+        if(tx->queued == 0)
+        { return 0; }
+        if(sr_uring_send(tx->uring, tx->iov, sr_tx_gather(tx)) != 0)
+        {
+            perror("io_uring_enter(..):sr_txq.c::sr_tx_flush");
+            return -1;
+        }
+        tx->inflight = 1;
+        return 0;
+    }
+
+    while(tx->queued > 0 && tx->fd >= 0)
+    {
+        sr_tx_gather(tx);
+
+        do
+        {
+            tx->syscalls++;
+            ret = writev(tx->fd, tx->iov, tx->niov);
+        }
+        while(ret < 0 && errno == EINTR);
+
+        if(ret < 0)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                tx->blocked++;
+                break;
+            }
+            perror("writev(..):sr_txq.c::sr_tx_flush");
+            return -1;
+        }
+
+        if(sr_tx_retire(tx, ret))
+        { break; }
+    }
+
+    sr_tx_arm(tx, tx->queued > 0);
+    return 0;
+} /* -- sr_tx_flush_locked -- */
+
+static int sr_tx_flush_now(struct sr_tx* tx)
+{
+    int ret;
+
+    pthread_mutex_lock(&(tx->lock));
+    ret = sr_tx_flush_locked(tx);
+    pthread_mutex_unlock(&(tx->lock));
+    return ret;
+} /* -- sr_tx_flush_now -- */
+
+/* while the socket is known to be full only EPOLLOUT triggers a write */
+int sr_tx_flush(struct sr_tx* tx)
+{
+    if(tx->out_armed)
+    { return 0; }
+    return sr_tx_flush_now(tx);
+} /* -- sr_tx_flush -- */
+
+/* the io_uring send has completed, so the next batch can go */
+void sr_tx_complete(struct sr_tx* tx)
+{ sr_tx_flush_now(tx); }
+
+/* writes the VNS header for a frame of len bytes on iface at buf */
+static unsigned int sr_tx_header(uint8_t* buf, const struct sr_if* iface,
+                                 unsigned int len)
+{
+    c_packet_header* hdr = (c_packet_header*)buf;
+    unsigned int total = len + sizeof(c_packet_header);
+
+    hdr->mLen  = htonl(total);
+    hdr->mType = htonl(VNSPACKET);
+    snprintf(hdr->mInterfaceName, sizeof(hdr->mInterfaceName), "%s",
+             iface->name);
+    return total;
+} /* -- sr_tx_header -- */
+
+/* links frame, VNS header in its headroom, to the end of queue q */
+static void sr_tx_link(struct sr_tx* tx, struct sr_txq* q,
+                       uint8_t* buf, unsigned int total, int lent)
+{
+    struct sr_txframe* f = &(q->ring[(q->head + q->num) % SR_TXQ_LEN]);
+
+    f->buf = buf;
+    f->len = total;
+    f->lent = lent;
+    q->num++;
+    if(q->num > q->max_depth)
+    { q->max_depth = q->num; }
+    tx->queued++;
+} /* -- sr_tx_link -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_enqueue(..)
+ * Scope:  Global
+ *
+ * Copies the frame behind a VNS header into a pool buffer at the tail
+ * of the interface's queue.  Frames accumulate until the caller
+ * flushes, or until a full writev() worth is queued.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_enqueue(struct sr_tx* tx, const struct sr_if* iface,
+                  const uint8_t* frame, unsigned int len)
+{
+    struct sr_txq* q;
+    unsigned int total = len + sizeof(c_packet_header);
+    uint8_t* buf;
+
+    pthread_mutex_lock(&(tx->lock));
+
+    q = &(tx->q[iface->index]);
+    if(q->num == SR_TXQ_LEN || (buf = (uint8_t*)sr_mbuf_get(total)) == 0)
+    {
+        q->drops++;
+        pthread_mutex_unlock(&(tx->lock));
+        return -1;
+    }
+
+    sr_tx_header(buf, iface, len);
+    memcpy(buf + sizeof(c_packet_header), frame, len);
+    sr_tx_link(tx, q, buf, total, 0);
+    tx->copied++;
+
+    /* -- a full socket is left to the epoll loop, frames of an io_uring
+          send in flight do not count -- */
+    if(tx->queued - tx->niov >= SR_TX_IOV_MAX && !tx->out_armed)
+    { sr_tx_flush_locked(tx); }
+
+    pthread_mutex_unlock(&(tx->lock));
+    return 0;
+} /* -- sr_tx_enqueue -- */
+
+int sr_tx_enqueue_buf(struct sr_tx* tx, const struct sr_if* iface,
+                      uint8_t* frame, unsigned int len)
+{
+    uint8_t* buf = frame - sizeof(c_packet_header);
+    struct sr_txq* q;
+
+    pthread_mutex_lock(&(tx->lock));
+
+    q = &(tx->q[iface->index]);
+    if(q->num == SR_TXQ_LEN)
+    {
+        pthread_mutex_unlock(&(tx->lock));
+        return -1;
+    }
+
+    sr_tx_link(tx, q, buf, sr_tx_header(buf, iface, len), 0);
+    tx->given++;
+
+    if(tx->queued - tx->niov >= SR_TX_IOV_MAX && !tx->out_armed)
+    { sr_tx_flush_locked(tx); }
+
+    pthread_mutex_unlock(&(tx->lock));
+    return 0;
+} /* -- sr_tx_enqueue_buf -- */
+
+int sr_tx_give(struct sr_tx* tx, const struct sr_if* iface,
+               uint8_t* frame, unsigned int len)
+{
+    if(sr_tx_enqueue_buf(tx, iface, frame, len) == 0)
+    { return 0; }
+
+    pthread_mutex_lock(&(tx->lock));
+    tx->q[iface->index].drops++;
+    pthread_mutex_unlock(&(tx->lock));
+    sr_mbuf_put(frame - sizeof(c_packet_header));
+    return -1;
+} /* -- sr_tx_give -- */
+
+int sr_tx_enqueue_lent(struct sr_tx* tx, const struct sr_if* iface,
+                       uint8_t* frame, unsigned int len)
+{
+    uint8_t* buf = frame - sizeof(c_packet_header);
+    struct sr_txq* q;
+
+    if(tx->uring)
+    { return sr_tx_enqueue(tx, iface, frame, len); }
+
+    pthread_mutex_lock(&(tx->lock));
+
+    q = &(tx->q[iface->index]);
+    if(q->num == SR_TXQ_LEN)
+    {
+        q->drops++;
+        pthread_mutex_unlock(&(tx->lock));
+        return -1;
+    }
+
+    sr_tx_link(tx, q, buf, sr_tx_header(buf, iface, len), 1);
+    tx->lent++;
+    tx->lends++;
+
+    if(tx->queued >= SR_TX_IOV_MAX && !tx->out_armed)
+    { sr_tx_flush_locked(tx); }
+
+    pthread_mutex_unlock(&(tx->lock));
+    return 0;
+} /* -- sr_tx_enqueue_lent -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_return_lent(..)
+ * Scope:  Global
+ *
+ * Gives every lent frame still on a queue a pool buffer of its own, so
+ * the buffer it was lent from can be reused.  The frame a short write
+ * stopped in is copied whole; partial_off still applies to the copy.
+ * A frame that finds no buffer is taken off its queue, unless it is
+ * that half written one.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_return_lent(struct sr_tx* tx)
+{
+    unsigned int i, j, k;
+    int ret = 0;
+    uint8_t* buf;
+
+    /* -- only the thread that lends can make this non-zero -- */
+    if(tx->lent == 0)
+    { return 0; }
+
+    pthread_mutex_lock(&(tx->lock));
+
+    for(i = 0; i < SR_IF_MAX && tx->lent > 0; i++)
+    {
+        struct sr_txq* q = &(tx->q[i]);
+
+        j = 0;
+        while(j < q->num)
+        {
+            struct sr_txframe* f = &(q->ring[(q->head + j) % SR_TXQ_LEN]);
+
+            if(!f->lent)
+            {
+                j++;
+                continue;
+            }
+            if((buf = (uint8_t*)sr_mbuf_get(f->len)) != 0)
+            {
+                memcpy(buf, f->buf, f->len);
+                f->buf = buf;
+                f->lent = 0;
+                tx->lent--;
+                tx->returned++;
+                j++;
+                continue;
+            }
+            if(tx->partial_q == (int)i && j == 0)
+            {
+                ret = -1;
+                j++;
+                continue;
+            }
+
+            /* -- dropped, the frames behind it move up a slot -- */
+            for(k = j; k + 1 < q->num; k++)
+            {
+                q->ring[(q->head + k) % SR_TXQ_LEN] =
+                    q->ring[(q->head + k + 1) % SR_TXQ_LEN];
+            }
+            q->num--;
+            q->drops++;
+            tx->queued--;
+            tx->lent--;
+        }
+    }
+
+    pthread_mutex_unlock(&(tx->lock));
+    return ret;
+} /* -- sr_tx_return_lent -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tx_wait(..)
+ * Scope:  Global
+ *
+ * Flushes, then sleeps in epoll_wait() until the socket has data to
+ * read or a signal arrives, writing queued frames whenever it reports
+ * room for them.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_tx_wait(struct sr_tx* tx)
+{
+    struct epoll_event ev[2];
+    int n, i, readable = 0;
+
+    if(sr_tx_flush(tx) < 0)
+    { return -1; }
+    if(tx->epfd < 0)
+    { return 0; }
+
+    while(!readable)
+    {
+        tx->syscalls++;
+        if((n = epoll_wait(tx->epfd, ev, 2, -1)) < 0)
+        {
+            /* -- the reader looks at why before it waits again -- */
+            if(errno == EINTR)
+            { return 0; }
+            perror("epoll_wait(..):sr_txq.c::sr_tx_wait");
+            return -1;
+        }
+
+        for(i = 0; i < n; i++)
+        {
+            if((ev[i].events & EPOLLOUT) && sr_tx_flush_now(tx) < 0)
+            { return -1; }
+            if(ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            { readable = 1; }
+        }
+    }
+
+    return 0;
+} /* -- sr_tx_wait -- */
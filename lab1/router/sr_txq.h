@@ -0,0 +1,155 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_txq.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Transmit side of the VNS connection.  Outgoing frames wait, VNS
+ * header included, on a queue per interface and are written out with
+ * writev(), up to SR_TX_IOV_MAX frames per call, taking
+ * one frame from each non-empty queue in turn.  Once sr_tx_attach() has
+ * made the socket non-blocking a short write is not an error: the rest
+ * of the frame goes out first on the next flush, which the epoll loop
+ * triggers when the socket becomes writable again.  A full queue drops
+ * the new frame instead of stalling the router.
+ *
+ * Most frames are not copied on the way.  A pool buffer with
+ * SR_PACKET_HEADROOM in front of the frame is handed over, the VNS
+ * header going into the headroom (sr_tx_enqueue_buf, sr_tx_give).  A
+ * frame forwarded in place in the VNS receive buffer is only lent
+ * (sr_tx_enqueue_lent): its header is written over the received one and
+ * the queue points into the buffer.  Before the reader reuses that
+ * buffer, sr_tx_return_lent() copies whatever the flush left queued.
+ * Other frames are copied into a pool buffer (sr_tx_enqueue).
+ *
+ * With io_uring (sr_uring) the same batches go out as sendmsg requests,
+ * one in flight at a time; the next flush after its completion retires
+ * the frames and submits the next batch.
+ *
+ * Frames are queued from the main thread or the forwarding workers and
+ * from the ARP cache thread, so every call takes the tx lock.  Once a
+ * writer thread (sr_writer) has set kick, only it writes; a flush from
+ * any other thread rings its bell instead.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TXQ_H
+#define SR_TXQ_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <sys/uio.h>
+
+#include "sr_if.h"
+
+#define SR_TXQ_LEN     256   /* frames queued per interface */
+#define SR_TX_IOV_MAX  64    /* frames per writev() */
+
+struct sr_txframe
+{
+    uint8_t* buf;               /* VNS header + frame, from sr_mbuf_get() */
+    unsigned int len;
+    int lent;                   /* buf is not ours, see sr_tx_return_lent() */
+};
+
+struct sr_txq
+{
+    struct sr_txframe ring[SR_TXQ_LEN];
+    unsigned int head;
+    unsigned int num;
+    unsigned long sent;         /* frames written completely */
+    unsigned long drops;        /* queue full, or no buffer */
+    unsigned int max_depth;
+};
+
+struct sr_uring;
+struct sr_busypoll;
+struct sr_bell;
+
+struct sr_tx
+{
+    int fd;                     /* VNS socket, -1 until attached */
+    int epfd;                   /* epoll set watching fd, -1 if none */
+    int out_armed;              /* EPOLLOUT is being waited for */
+    int partial_q;              /* queue whose head is half written, or -1 */
+    unsigned int partial_off;   /* bytes of it already written */
+    unsigned int queued;        /* frames on all queues */
+    unsigned int lent;          /* of them, lent frames */
+    unsigned int next_q;        /* where the next round robin pass starts */
+    unsigned long writes;       /* writev() calls that wrote something */
+    unsigned long frames;       /* frames those calls completed */
+    unsigned long blocked;      /* flushes cut short by a full socket */
+    unsigned long syscalls;     /* writev, epoll_wait and epoll_ctl calls */
+    unsigned long given;        /* frames queued in the buffer they came in */
+    unsigned long lends;        /* frames lent */
+    unsigned long returned;     /* lent frames copied before the buffer's reuse */
+    unsigned long copied;       /* frames copied when queued */
+    struct sr_uring* uring;     /* io_uring transport, or 0 for epoll */
+    int inflight;               /* an io_uring send owns iov */
+    struct iovec iov[SR_TX_IOV_MAX];    /* batch being written */
+    int owner[SR_TX_IOV_MAX];   /* queue of each iov */
+    unsigned int niov;
+    struct sr_bell* kick;       /* writer thread's bell, or 0 */
+    pthread_t writer;           /* the only thread writing once kick is set */
+    struct sr_txq q[SR_IF_MAX];
+    pthread_mutex_t lock;
+};
+
+void sr_tx_init(struct sr_tx* tx);
+void sr_tx_destroy(struct sr_tx* tx);
+
+/* Hands fd to io_uring if use_uring is set and that works, else makes it
+   non-blocking and, unless bp busy polls, sets up the epoll set used by
+   sr_tx_wait(). */
+int  sr_tx_attach(struct sr_tx* tx, int fd, int use_uring,
+                  struct sr_busypoll* bp);
+
+/* Queues len bytes of frame for interface iface.  Returns 0, or -1 if the
+   frame was dropped. */
+int  sr_tx_enqueue(struct sr_tx* tx, const struct sr_if* iface,
+                   const uint8_t* frame, unsigned int len);
+
+/* Queues the pool buffer frame, allocated with SR_PACKET_HEADROOM in
+   front, without copying it; the VNS header goes into the headroom.
+   Returns 0 once the queue owns frame, or -1 if the queue is full and
+   the caller still does. */
+int  sr_tx_enqueue_buf(struct sr_tx* tx, const struct sr_if* iface,
+                       uint8_t* frame, unsigned int len);
+
+/* sr_tx_enqueue_buf() that frees frame if the queue is full.  Returns 0,
+   or -1 if the frame was dropped. */
+int  sr_tx_give(struct sr_tx* tx, const struct sr_if* iface,
+                uint8_t* frame, unsigned int len);
+
+/* Queues frame without copying it or taking its buffer; the
+   SR_PACKET_HEADROOM bytes in front of it are overwritten.  The frame
+   must stay put until sr_tx_return_lent().  Under io_uring, where a
+   send in flight may point into it, frame is copied instead.  Returns 0,
+   or -1 if the frame was dropped. */
+int  sr_tx_enqueue_lent(struct sr_tx* tx, const struct sr_if* iface,
+                        uint8_t* frame, unsigned int len);
+
+/* Copies the lent frames still queued into pool buffers.  A frame no
+   buffer is left for is dropped.  Returns -1 if that frame was already
+   half written, which leaves the stream broken, else 0. */
+int  sr_tx_return_lent(struct sr_tx* tx);
+
+/* Writes as much as the socket takes.  Returns -1 on a write error. */
+int  sr_tx_flush(struct sr_tx* tx);
+
+/* The io_uring send in flight has completed; called by sr_uring_recv(). */
+void sr_tx_complete(struct sr_tx* tx);
+
+/* Blocks until fd is readable, flushing whenever it becomes writable.
+   A signal ends the wait early.  Returns -1 on error. */
+int  sr_tx_wait(struct sr_tx* tx);
+
+#endif /* -- SR_TXQ_H -- */
@@ -0,0 +1,512 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_uring.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * io_uring transport for the VNS connection.  See sr_uring.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "sr_uring.h"
+#include "sr_txq.h"
+#include "sr_busypoll.h"
+
+#if defined(_LINUX_) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SR_HAVE_URING 1
+#endif
+#endif
+
+#ifdef SR_HAVE_URING
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define SR_URING_BGID      1
+#define SR_URING_TAG_RECV  1
+#define SR_URING_TAG_SEND  2
+
+/* a filled receive buffer not yet copied out completely */
+struct sr_uring_rxbuf
+{
+    unsigned short bid;
+    unsigned int len;
+    unsigned int off;
+};
+
+struct sr_uring
+{
+    int ring_fd;
+    int sock;
+    struct sr_tx* tx;
+    struct sr_busypoll* bp;
+
+    /* -- submission queue -- */
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    struct io_uring_sqe* sqes;
+    unsigned int unsubmitted;
+
+    /* -- completion queue -- */
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ptr;
+    size_t sq_sz;
+    void* cq_ptr;
+    size_t cq_sz;
+    size_t sqes_sz;
+
+    /* -- provided receive buffers -- */
+    struct io_uring_buf_ring* br;
+    size_t br_sz;
+    unsigned char* bufs;
+    unsigned short br_tail;
+    struct sr_uring_rxbuf ready[SR_URING_BUFS];
+    unsigned int ready_head;
+    unsigned int ready_num;
+    int recv_armed;
+    int closed;
+
+    struct msghdr send_msg;     /* of the send in flight */
+    int send_done;              /* its completion has been reaped */
+    int send_res;
+    pthread_t owner;            /* the only thread reaping completions */
+
+    unsigned long enters;
+    pthread_mutex_t lock;       /* submission queue */
+};
+
+static int sr_uring_enter(struct sr_uring* u, unsigned int to_submit,
+                          unsigned int min_complete, unsigned int flags)
+{
+    int ret;
+
+    __sync_fetch_and_add(&(u->enters), 1);
+    do
+    {
+        ret = syscall(__NR_io_uring_enter, u->ring_fd, to_submit,
+                      min_complete, flags, NULL, 0);
+    } while(ret < 0 && errno == EINTR && !(flags & IORING_ENTER_GETEVENTS));
+    return ret;
+} /* -- sr_uring_enter -- */
+
+/* caller holds u->lock; the entry is published by sr_uring_submit_locked() */
+static struct io_uring_sqe* sr_uring_get_sqe(struct sr_uring* u)
+{
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    unsigned index;
+    struct io_uring_sqe* sqe;
+
+    if(u->sq_local_tail - head >= u->sq_entries)
+    { return 0; }
+
+    index = u->sq_local_tail & *(u->sq_mask);
+    sqe = &(u->sqes[index]);
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[index] = index;
+    u->sq_local_tail++;
+    u->unsubmitted++;
+    return sqe;
+} /* -- sr_uring_get_sqe -- */
+
+static int sr_uring_submit_locked(struct sr_uring* u)
+{
+    unsigned int n = u->unsubmitted;
+
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+    u->unsubmitted = 0;
+    if(n == 0)
+    { return 0; }
+    return sr_uring_enter(u, n, 0, 0) < 0 ? -1 : 0;
+} /* -- sr_uring_submit_locked -- */
+
+/* gives receive buffer bid back to the kernel */
+static void sr_uring_buf_add(struct sr_uring* u, unsigned short bid)
+{
+    struct io_uring_buf* b = &(u->br->bufs[u->br_tail & (SR_URING_BUFS - 1)]);
+
+    b->addr = (unsigned long)(u->bufs + (size_t)bid * SR_URING_BUF_SIZE);
+    b->len = SR_URING_BUF_SIZE;
+    b->bid = bid;
+    u->br_tail++;
+    __atomic_store_n(&(u->br->tail), u->br_tail, __ATOMIC_RELEASE);
+} /* -- sr_uring_buf_add -- */
+
+static int sr_uring_arm_recv(struct sr_uring* u)
+{
+    struct io_uring_sqe* sqe;
+    int ret = -1;
+
+    pthread_mutex_lock(&(u->lock));
+    if((sqe = sr_uring_get_sqe(u)) != 0)
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = u->sock;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = SR_URING_BGID;
+        sqe->user_data = SR_URING_TAG_RECV;
+        ret = sr_uring_submit_locked(u);
+    }
+    pthread_mutex_unlock(&(u->lock));
+
+    if(ret == 0)
+    { u->recv_armed = 1; }
+    return ret;
+} /* -- sr_uring_arm_recv -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_recv_refused(..)
+ * Scope:  Local
+ *
+ * Buffer rings (5.19) predate multishot recv (6.0), so a kernel can
+ * take the former and refuse the latter.  The refusal is posted while
+ * the recv is submitted; this looks for it without consuming anything
+ * and returns its errno, or 0 if the recv was taken.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_uring_recv_refused(struct sr_uring* u)
+{
+    unsigned head = *(u->cq_head);
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++)
+    {
+        struct io_uring_cqe* cqe = &(u->cqes[head & *(u->cq_mask)]);
+
+        if(cqe->user_data == SR_URING_TAG_RECV && cqe->res < 0 &&
+           cqe->res != -ENOBUFS)
+        { return -(cqe->res); }
+    }
+    return 0;
+} /* -- sr_uring_recv_refused -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_reap(..)
+ * Scope:  Local
+ *
+ * Consumes every completion posted so far.  Received buffers are put
+ * on the ready list, the send result is kept for sr_uring_send_done().
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_uring_reap(struct sr_uring* u)
+{
+    unsigned head = *(u->cq_head);
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    int ret = 0;
+
+    for(; head != tail; head++)
+    {
+        struct io_uring_cqe* cqe = &(u->cqes[head & *(u->cq_mask)]);
+
+        if(cqe->user_data == SR_URING_TAG_SEND)
+        {
+            u->send_res = cqe->res;
+            u->send_done = 1;
+            continue;
+        }
+
+        if(!(cqe->flags & IORING_CQE_F_MORE))
+        { u->recv_armed = 0; }
+
+        if(cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+        {
+            struct sr_uring_rxbuf* r =
+                &(u->ready[(u->ready_head + u->ready_num) % SR_URING_BUFS]);
+
+            r->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            r->len = cqe->res;
+            r->off = 0;
+            u->ready_num++;
+        }
+        else if(cqe->res == 0)
+        { u->closed = 1; }
+        else if(cqe->res != -ENOBUFS)
+        {
+            /* -- out of buffers only needs a re-arm -- */
+            errno = -(cqe->res);
+            perror("recv(..):sr_uring.c::sr_uring_reap");
+            ret = -1;
+        }
+    }
+
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return ret;
+} /* -- sr_uring_reap -- */
+
+int sr_uring_recv(struct sr_uring* u, void* buf, unsigned int len)
+{
+    unsigned int copied = 0;
+
+    while(copied == 0)
+    {
+        /* -- hand out what has arrived, recycling emptied buffers -- */
+        while(u->ready_num > 0 && copied < len)
+        {
+            struct sr_uring_rxbuf* r = &(u->ready[u->ready_head]);
+            unsigned int n = r->len - r->off;
+
+            if(n > len - copied)
+            { n = len - copied; }
+            memcpy((unsigned char*)buf + copied,
+                   u->bufs + (size_t)r->bid * SR_URING_BUF_SIZE + r->off, n);
+            copied += n;
+            r->off += n;
+            if(r->off == r->len)
+            {
+                sr_uring_buf_add(u, r->bid);
+                u->ready_head = (u->ready_head + 1) % SR_URING_BUFS;
+                u->ready_num--;
+            }
+        }
+        if(copied > 0)
+        { break; }
+        if(u->closed)
+        { return 0; }
+
+        if(!u->recv_armed && sr_uring_arm_recv(u) != 0)
+        {
+            perror("io_uring_enter(..):sr_uring.c::sr_uring_recv");
+            return -1;
+        }
+        if(u->bp->idle_us)
+        {
+            /* -- completions land in shared memory, no need to ask -- */
+            if(*(u->cq_head) == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+            {
+                sr_busypoll_idle(u->bp);
+                continue;
+            }
+        }
+        else
+        {
+            if(sr_uring_enter(u, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+            {
+                if(errno != EINTR)
+                { perror("io_uring_enter(..):sr_uring.c::sr_uring_recv"); }
+                return -1;
+            }
+            u->bp->wakeups++;
+        }
+        if(sr_uring_reap(u) != 0)
+        { return -1; }
+        if(u->send_done)
+        { sr_tx_complete(u->tx); }
+    }
+
+    return copied;
+} /* -- sr_uring_recv -- */
+
+int sr_uring_send(struct sr_uring* u, struct iovec* iov, unsigned int n)
+{
+    struct io_uring_sqe* sqe;
+    int ret = -1;
+
+    pthread_mutex_lock(&(u->lock));
+    if((sqe = sr_uring_get_sqe(u)) != 0)
+    {
+        memset(&(u->send_msg), 0, sizeof(u->send_msg));
+        u->send_msg.msg_iov = iov;
+        u->send_msg.msg_iovlen = n;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = u->sock;
+        sqe->addr = (unsigned long)&(u->send_msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = SR_URING_TAG_SEND;
+        ret = sr_uring_submit_locked(u);
+    }
+    pthread_mutex_unlock(&(u->lock));
+    return ret;
+} /* -- sr_uring_send -- */
+
+int sr_uring_send_done(struct sr_uring* u, int* res)
+{
+    if(!pthread_equal(pthread_self(), u->owner))
+    { return 0; }
+    if(!u->send_done && sr_uring_reap(u) != 0)
+    { return 0; }
+    if(!u->send_done)
+    { return 0; }
+
+    u->send_done = 0;
+    *res = u->send_res;
+    return 1;
+} /* -- sr_uring_send_done -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_create(..)
+ * Scope:  Global
+ *
+ * Sets up the rings, registers the provided buffers and arms the
+ * multishot recv.  Any failure, typically an old kernel or io_uring
+ * being disabled, undoes what was done and returns 0.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_uring* sr_uring_create(int fd, struct sr_tx* tx,
+                                 struct sr_busypoll* bp)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    struct sr_uring* u;
+    unsigned int i;
+
+    if((u = (struct sr_uring*)calloc(1, sizeof(struct sr_uring))) == 0)
+    { return 0; }
+    u->sock = fd;
+    u->tx = tx;
+    u->bp = bp;
+    u->owner = pthread_self();
+    u->sq_ptr = u->cq_ptr = MAP_FAILED;
+    u->sqes = (struct io_uring_sqe*)MAP_FAILED;
+    u->br = (struct io_uring_buf_ring*)MAP_FAILED;
+    u->ring_fd = -1;
+    pthread_mutex_init(&(u->lock), 0);
+
+    memset(&p, 0, sizeof(p));
+    u->ring_fd = syscall(__NR_io_uring_setup, SR_URING_ENTRIES, &p);
+    if(u->ring_fd < 0)
+    { goto fail; }
+
+    u->sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(u->cq_sz > u->sq_sz)
+        { u->sq_sz = u->cq_sz; }
+        u->cq_sz = u->sq_sz;
+    }
+
+    u->sq_ptr = mmap(0, u->sq_sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+    if(u->sq_ptr == MAP_FAILED)
+    { goto fail; }
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    { u->cq_ptr = u->sq_ptr; }
+    else
+    {
+        u->cq_ptr = mmap(0, u->cq_sz, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, u->ring_fd,
+                         IORING_OFF_CQ_RING);
+        if(u->cq_ptr == MAP_FAILED)
+        { goto fail; }
+    }
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(0, u->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED)
+    { goto fail; }
+
+    u->sq_head = (unsigned*)((char*)u->sq_ptr + p.sq_off.head);
+    u->sq_tail = (unsigned*)((char*)u->sq_ptr + p.sq_off.tail);
+    u->sq_mask = (unsigned*)((char*)u->sq_ptr + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)((char*)u->sq_ptr + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->sq_local_tail = *(u->sq_tail);
+    u->cq_head = (unsigned*)((char*)u->cq_ptr + p.cq_off.head);
+    u->cq_tail = (unsigned*)((char*)u->cq_ptr + p.cq_off.tail);
+    u->cq_mask = (unsigned*)((char*)u->cq_ptr + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)((char*)u->cq_ptr + p.cq_off.cqes);
+
+    /* -- the buffer ring must be page aligned, so mmap it -- */
+    u->br_sz = SR_URING_BUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(0, u->br_sz, PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(u->br == MAP_FAILED)
+    { goto fail; }
+    if((u->bufs = (unsigned char*)malloc((size_t)SR_URING_BUFS *
+                                         SR_URING_BUF_SIZE)) == 0)
+    { goto fail; }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)u->br;
+    reg.ring_entries = SR_URING_BUFS;
+    reg.bgid = SR_URING_BGID;
+    if(syscall(__NR_io_uring_register, u->ring_fd,
+               IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    { goto fail; }
+
+    for(i = 0; i < SR_URING_BUFS; i++)
+    { sr_uring_buf_add(u, i); }
+
+    if(sr_uring_arm_recv(u) != 0)
+    { goto fail; }
+    if((errno = sr_uring_recv_refused(u)) != 0)
+    { goto fail; }
+
+    return u;
+
+fail:
+    perror("io_uring:sr_uring.c::sr_uring_create");
+    sr_uring_destroy(u);
+    return 0;
+} /* -- sr_uring_create -- */
+
+void sr_uring_destroy(struct sr_uring* u)
+{
+    if(!u)
+    { return; }
+
+    if(u->ring_fd >= 0)
+    { close(u->ring_fd); }
+    if(u->sqes != MAP_FAILED)
+    { munmap(u->sqes, u->sqes_sz); }
+    if(u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+    { munmap(u->cq_ptr, u->cq_sz); }
+    if(u->sq_ptr != MAP_FAILED)
+    { munmap(u->sq_ptr, u->sq_sz); }
+    if(u->br != MAP_FAILED)
+    { munmap(u->br, u->br_sz); }
+    free(u->bufs);
+    pthread_mutex_destroy(&(u->lock));
+    free(u);
+} /* -- sr_uring_destroy -- */
+
+unsigned long sr_uring_syscalls(struct sr_uring* u)
+{ return u ? u->enters : 0; }
+
+#else /* -- !SR_HAVE_URING -- */
+
+struct sr_uring* sr_uring_create(int fd, struct sr_tx* tx,
+                                 struct sr_busypoll* bp)
+{
+    fprintf(stderr, "io_uring: not supported by this build\n");
+    return 0;
+} /* -- sr_uring_create -- */
+
+void sr_uring_destroy(struct sr_uring* u) { }
+
+int sr_uring_recv(struct sr_uring* u, void* buf, unsigned int len)
+{ return -1; }
+
+int sr_uring_send(struct sr_uring* u, struct iovec* iov, unsigned int n)
+{ return -1; }
+
+int sr_uring_send_done(struct sr_uring* u, int* res)
+{ return 0; }
+
+unsigned long sr_uring_syscalls(struct sr_uring* u)
+{ return 0; }
+
+#endif /* -- SR_HAVE_URING -- */
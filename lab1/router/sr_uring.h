@@ -0,0 +1,60 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_uring.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Optional io_uring transport for the VNS connection, driven through the
+ * raw system calls.  One multishot recv stays armed on the socket and
+ * fills buffers from a registered ring of SR_URING_BUFS provided
+ * buffers; sr_uring_recv() copies their bytes out and hands each buffer
+ * straight back to the kernel.  The transmit queues (sr_txq) send each
+ * gathered batch of frames as one sendmsg request and collect its result
+ * with sr_uring_send_done().
+ *
+ * Completions are reaped only by the thread that created the ring, which
+ * is the one calling sr_uring_recv(), so it never sleeps on a completion
+ * another thread took.  Sends may be submitted from any thread.  Without
+ * kernel or header support sr_uring_create() fails and the caller stays
+ * on the epoll path.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_URING_H
+#define SR_URING_H
+
+#include <sys/uio.h>
+
+#define SR_URING_ENTRIES  64
+#define SR_URING_BUFS     64     /* provided receive buffers, power of two */
+#define SR_URING_BUF_SIZE 16384
+
+struct sr_uring;
+struct sr_tx;
+struct sr_busypoll;
+
+/* Returns 0 if io_uring cannot be used on this host.  With bp busy
+   polling sr_uring_recv() polls the completion ring instead of waiting
+   in the kernel. */
+struct sr_uring* sr_uring_create(int fd, struct sr_tx* tx,
+                                 struct sr_busypoll* bp);
+void sr_uring_destroy(struct sr_uring* u);
+
+/* Waits for received bytes and copies up to len of them to buf.  Returns
+   the number copied, 0 once the server has closed the connection, or -1
+   on error or, with errno EINTR, when a signal ended the wait.  Calls
+   sr_tx_complete() when it meets a send completion. */
+int  sr_uring_recv(struct sr_uring* u, void* buf, unsigned int len);
+
+/* Submits one sendmsg of the n iovecs, which must stay untouched until
+   sr_uring_send_done() has returned its result.  Returns -1 on error. */
+int  sr_uring_send(struct sr_uring* u, struct iovec* iov, unsigned int n);
+
+/* Returns 1 and the byte count or -errno in res once the send has
+   completed, without blocking.  Always 0 off the owning thread. */
+int  sr_uring_send_done(struct sr_uring* u, int* res);
+
+/* io_uring_enter() calls made so far. */
+unsigned long sr_uring_syscalls(struct sr_uring* u);
+
+#endif /* -- SR_URING_H -- */
@@ -5,20 +5,167 @@
 #include "sr_utils.h"
 
 
-uint16_t cksum (const void *_data, int len) {
-  const uint8_t *data = _data;
-  uint32_t sum;
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CKSUM_X86 1
+#endif
+
+/*
+ * Internet checksum.
+ *
+ * The one's complement sum does not care about byte order, so the
+ * kernels below add the data as native 32-bit words into 64-bit
+ * accumulators and the folded, complemented result is already in
+ * network order.  The answer is identical to the classic 16-bit
+ * big-endian loop, including 0xffff in place of a zero result.
+ *
+ * cksum() dispatches to the widest kernel the CPU supports; the choice
+ * is made on the first call.
+ */
+
+/* Adds len bytes to sum, eight at a time as two 32-bit halves. */
+static uint64_t cksum_add (const uint8_t *data, int len, uint64_t sum) {
+  uint64_t w64;
+  uint32_t w32;
+  uint16_t w16;
+  uint8_t last[2];
+
+  for (; len >= 8; data += 8, len -= 8) {
+    memcpy(&w64, data, 8);
+    sum += (w64 & 0xffffffff) + (w64 >> 32);
+  }
+  if (len >= 4) {
+    memcpy(&w32, data, 4);
+    sum += w32;
+    data += 4;
+    len -= 4;
+  }
+  if (len >= 2) {
+    memcpy(&w16, data, 2);
+    sum += w16;
+    data += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    /* odd byte is the high half of a big-endian word */
+    last[0] = data[0];
+    last[1] = 0;
+    memcpy(&w16, last, 2);
+    sum += w16;
+  }
+  return sum;
+}
 
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
+static uint16_t cksum_finish (uint64_t sum) {
   while (sum > 0xffff)
     sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
+  sum = (uint16_t)~sum;
   return sum ? sum : 0xffff;
 }
 
+static uint16_t cksum_word (const void *_data, int len) {
+  return cksum_finish(cksum_add(_data, len, 0));
+}
+
+#ifdef CKSUM_X86
+/* 32-bit lanes are widened into 64-bit accumulators, so nothing can
+   overflow whatever the length. */
+__attribute__ ((target ("sse2")))
+static uint16_t cksum_sse2 (const void *_data, int len) {
+  const uint8_t *data = _data;
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = zero, acc1 = zero;
+  uint64_t lanes[2];
+
+  for (; len >= 32; data += 32, len -= 32) {
+    __m128i a = _mm_loadu_si128((const __m128i *)data);
+    __m128i b = _mm_loadu_si128((const __m128i *)(data + 16));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+  }
+  _mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(acc0, acc1));
+  return cksum_finish(cksum_add(data, len, lanes[0] + lanes[1]));
+}
+
+__attribute__ ((target ("avx2")))
+static uint16_t cksum_avx2 (const void *_data, int len) {
+  const uint8_t *data = _data;
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero;
+  uint64_t lanes[4];
+
+  for (; len >= 64; data += 64, len -= 64) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)data);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(data + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+  return cksum_finish(cksum_add(data, len,
+                                lanes[0] + lanes[1] + lanes[2] + lanes[3]));
+}
+#endif
+
+static uint16_t cksum_select (const void *_data, int len);
+static uint16_t (*cksum_impl) (const void *, int) = cksum_select;
+
+static uint16_t cksum_select (const void *_data, int len) {
+  cksum_impl = cksum_word;
+#ifdef CKSUM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    cksum_impl = cksum_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    cksum_impl = cksum_sse2;
+#endif
+  return cksum_impl(_data, len);
+}
+
+uint16_t cksum (const void *_data, int len) {
+  return cksum_impl(_data, len);
+}
+
+int cksum_use (const char *kernel) {
+  if (strcmp(kernel, "auto") == 0)
+    cksum_impl = cksum_select;
+  else if (strcmp(kernel, "word") == 0)
+    cksum_impl = cksum_word;
+#ifdef CKSUM_X86
+  else if (strcmp(kernel, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    cksum_impl = cksum_sse2;
+  else if (strcmp(kernel, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    cksum_impl = cksum_avx2;
+#endif
+  else
+    return -1;
+  return 0;
+}
+
+uint64_t cksum_partial (const void *_data, int len, uint64_t sum) {
+  return cksum_add(_data, len, sum);
+}
+
+uint16_t cksum_fold (uint64_t sum) {
+  return cksum_finish(sum);
+}
+
+/* Incrementally update checksum 'sum' after one 16-bit word of the data
+   changed from old_word to new_word (RFC 1624, eqn. 3).  All three are
+   taken as stored in the packet. */
+uint16_t cksum_update(uint16_t sum, uint16_t old_word, uint16_t new_word) {
+  uint32_t s;
+
+  s = (uint16_t)~sum + (uint16_t)~old_word + new_word;
+  while (s > 0xffff)
+    s = (s >> 16) + (s & 0xffff);
+  s = (uint16_t)~s;
+  return s ? s : 0xffff;
+}
+
 
 uint16_t ethertype(uint8_t *buf) {
   sr_ethernet_hdr_t *ehdr = (sr_ethernet_hdr_t *)buf;
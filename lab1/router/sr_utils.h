@@ -29,6 +29,15 @@
 #define SR_UTILS_H
 
 uint16_t cksum(const void *_data, int len);
+/* Pins cksum() to one kernel, "word", "sse2" or "avx2", or back to
+   "auto"; for cksum_bench.  Returns -1 if the CPU lacks the kernel. */
+int cksum_use(const char *kernel);
+uint16_t cksum_update(uint16_t sum, uint16_t old_word, uint16_t new_word);
+/* Unfinished sum of len bytes added to sum, for headers built in pieces;
+   every piece but the last must start at an even offset.  cksum_fold()
+   turns it into the checksum. */
+uint64_t cksum_partial(const void *_data, int len, uint64_t sum);
+uint16_t cksum_fold(uint64_t sum);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
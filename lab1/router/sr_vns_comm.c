@@ -39,6 +39,14 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_mbuf.h"
+#include "sr_uring.h"
+#include "sr_afpacket.h"
+#include "sr_busypoll.h"
+#include "sr_worker.h"
+#include "sr_writer.h"
+#include "sr_pcaplog.h"
 #include "sr_protocol.h"
 
 #include "sha1.h"
@@ -48,7 +56,7 @@ static void sr_log_packet(struct sr_instance* , uint8_t* , int );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_if* iface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
 
 /*-----------------------------------------------------------------------------
@@ -81,6 +89,7 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
     c_open_template ot;
     char* buf;
     uint32_t buf_len;
+    int one = 1;
 
     /* REQUIRES */
     assert(sr);
@@ -159,6 +168,13 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         if(sr_read_from_server_expect(sr, VNS_RTABLE) != 1)
             return -1; /* needed to get the rtable */
 
+    /* -- receive timestamps, for the forwarding latency -- */
+    setsockopt(sr->sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+
+    /* from here on frames are queued and written without blocking */
+    if(sr_tx_attach(&(sr->tx), sr->sockfd, sr->use_uring, &(sr->busy)) != 0)
+        return -1;
+
     return 0;
 } /* -- sr_connect_to_server -- */
 
@@ -177,6 +193,7 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 {
     int num_entries;
     int i = 0;
+    int skip = 1; /* -- no interface yet, or the last one was refused -- */
 
     /* REQUIRES */
     assert(sr);
@@ -196,7 +213,7 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
                 break;
             case HWINTERFACE:
                 /*Debug("INTERFACE: %s\n",hwinfo->mHWInfo[i].value);*/
-                sr_add_interface(sr,hwinfo->mHWInfo[i].value);
+                skip = sr_add_interface(sr,hwinfo->mHWInfo[i].value) != 0;
                 break;
             case HWSPEED:
                 /* Debug("Speed: %d\n",
@@ -213,13 +230,15 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
             case HWETHIP:
                 /*Debug("IP: %s\n",inet_ntoa(
                             *((struct in_addr*)(hwinfo->mHWInfo[i].value))));*/
-                sr_set_ether_ip(sr,*((uint32_t*)hwinfo->mHWInfo[i].value));
+                if ( !skip )
+                { sr_set_ether_ip(sr,*((uint32_t*)hwinfo->mHWInfo[i].value)); }
                 break;
             case HWETHER:
                 /*Debug("\tHardware Address: ");
                 DebugMAC(hwinfo->mHWInfo[i].value);
                 Debug("\n"); */
-                sr_set_ether_addr(sr,(unsigned char*)hwinfo->mHWInfo[i].value);
+                if ( !skip )
+                { sr_set_ether_addr(sr,(unsigned char*)hwinfo->mHWInfo[i].value); }
                 break;
             default:
                 printf (" %d \n",ntohl(hwinfo->mHWInfo[i].mKey));
@@ -228,6 +247,10 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 
     printf("Router interfaces:\n");
     sr_print_if_list(sr);
+    sr_if_build_templates(sr);
+
+    /* -- routes were loaded before their interfaces existed -- */
+    sr_rt_bind_interfaces(sr);
 
     return num_entries;
 } /* -- sr_handle_hwinfo -- */
@@ -331,131 +354,28 @@ int sr_read_from_server(struct sr_instance* sr /* borrowed */)
     return sr_read_from_server_expect(sr, 0);
 }
 
-int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
-{
-    int command, len;
-    unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
-
-    /* REQUIRES */
-    assert(sr);
-
-    /*---------------------------------------------------------------------------
-      Read a command from the server
-      -------------------------------------------------------------------------*/
-
-    bytes_read = 0;
-
-    /* attempt to read the size of the incoming packet */
-    while( bytes_read < 4)
-    {
-        do
-        { /* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if((ret = recv(sr->sockfd,((uint8_t*)&len) + bytes_read,
-                            4 - bytes_read, 0)) == -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-
-                perror("recv(..):sr_client.c::sr_read_from_server");
-                return -1;
-            }
-            bytes_read += ret;
-        } while ( errno == EINTR); /* be mindful of signals */
-
-    }
-
-    len = ntohl(len);
-
-    if ( len > 10000 || len < 0 )
-    {
-        fprintf(stderr,"Error: command length to large %d\n",len);
-        close(sr->sockfd);
-        return -1;
-    }
-
-    if((buf = malloc(len)) == 0)
-    {
-        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
-        return -1;
-    }
-
-    /* set first field of command since we've already read it */
-    *((int *)buf) = htonl(len);
-
-    bytes_read = 0;
-
-    /* read the rest of the command */
-    while ( bytes_read < len - 4)
-    {
-        do
-        {/* -- just in case SIGALRM breaks recv -- */
-            errno = 0; /* -- hacky glibc workaround -- */
-            if ((ret = read(sr->sockfd, buf+4+bytes_read, len - 4 - bytes_read)) ==
-                    -1)
-            {
-                if ( errno == EINTR )
-                { continue; }
-                fprintf(stderr,"Error: failed reading command body %d\n",ret);
-                close(sr->sockfd);
-                return -1;
-            }
-            bytes_read += ret;
-        } while (errno == EINTR); /* be mindful of signals */
-    }
-
-    /* My entry for most unreadable line of code - guido */
-    /* ... you win - mc                                  */
-    command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_command(..)
+ * Scope: Local
+ *
+ * Acts on one complete command other than VNSPACKET.  Returns 1 to keep
+ * reading, 0 if the server closed the session and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
 
-    /* make sure the command is what we expected if we were expecting something */
-    if(expected_cmd && command!=expected_cmd) {
-        if(command != VNSCLOSE) { /* VNSCLOSE is always ok */
-            fprintf(stderr, "Error: expected command %d but got %d\n", expected_cmd, command);
-            return -1;
-        }
-    }
+static int sr_handle_command(struct sr_instance* sr /* borrowed */,
+                             uint8_t* buf /* borrowed */, int command)
+{
+    int ret = 1;
 
-    ret = 1;
     switch (command)
     {
-        /* -------------        VNSPACKET     -------------------- */
-
-        case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
-            { break; }
-
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
-
-            break;
-
             /* -------------        VNSCLOSE      -------------------- */
 
         case VNSCLOSE:
             fprintf(stderr,"VNS server closed session.\n");
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
-
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -475,6 +395,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 return -1;
             }
             printf(" <-- Ready to process packets --> \n");
+            sr_arp_preresolve(sr);
             break;
 
             /* ---------------- VNS_RTABLE ---------------- */
@@ -501,9 +422,280 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
     return ret;
+} /* -- sr_handle_command -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_packet(..)
+ * Scope: Local
+ *
+ * Checks one VNSPACKET and adds its frame to the burst.  The frame stays
+ * in the receive buffer; its VNS header doubles as headroom for an in
+ * place reply, which is why the interface is resolved here.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_rx_packet(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */, int len,
+                         uint8_t** pkts, unsigned int* lens,
+                         struct sr_if** ifaces, unsigned int* n)
+{
+    c_packet_header* sr_pkt = (c_packet_header*)buf;
+    char iface[sr_IFACE_NAMELEN];
+    struct sr_if* ifrec;
+    uint8_t* frame = buf + sizeof(c_packet_header);
+    unsigned int frame_len;
+
+    if ( len < (int)sizeof(c_packet_ethernet_header) )
+    { return; }
+    frame_len = len - sizeof(c_packet_header);
+
+    memset(iface, 0, sizeof(iface));
+    memcpy(iface, sr_pkt->mInterfaceName, sizeof(sr_pkt->mInterfaceName));
+    if ( (ifrec = sr_get_interface(sr, iface)) == 0 )
+    { return; }
+
+    sr_rx_frame(sr, frame, frame_len, ifrec, pkts, lens, ifaces, n);
+} /* -- sr_rx_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_rx_frame(..)
+ * Scope: Global
+ *
+ * Filters and logs one frame received on iface and adds it to the burst
+ * handed to sr_handlepacket_burst(..).  Shared by every receive path.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_rx_frame(struct sr_instance* sr /* borrowed */,
+                 uint8_t* frame /* borrowed */, unsigned int len,
+                 struct sr_if* iface /* borrowed */,
+                 uint8_t** pkts, unsigned int* lens,
+                 struct sr_if** ifaces, unsigned int* n)
+{
+    /* -- check if it is an ARP to another router if so drop   -- */
+    if ( sr_arp_req_not_for_us(sr, frame, len, iface) )
+    { return; }
+
+    /* -- log packet -- */
+    sr_log_packet(sr, frame, len);
+
+    pkts[*n] = frame;
+    lens[*n] = len;
+    ifaces[*n] = iface;
+    (*n)++;
+    sr->rx.frames++;
+} /* -- sr_rx_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_recv_stamped(..)
+ * Scope: Local
+ *
+ * recv() that also returns when the kernel received the data, or now if
+ * the socket does not report it.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_recv_stamped(int fd, uint8_t* buf, size_t len, uint64_t* stamp)
+{
+    char ctl[CMSG_SPACE(sizeof(struct timespec))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* c;
+    int ret;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+
+    if ( (ret = recvmsg(fd, &msg, 0)) <= 0 )
+    { return ret; }
+
+    *stamp = 0;
+    for ( c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c) )
+    {
+        if ( c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS )
+        {
+            struct timespec ts;
+
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            /* -- the kernel stamps by the wall clock, latency is timed
+                  on the monotonic one -- */
+            *stamp = sr_busypoll_now() - sr_busypoll_age(
+                (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+                sr_busypoll_wall());
+        }
+    }
+    if ( *stamp == 0 )
+    { *stamp = sr_busypoll_now(); }
+    return ret;
+} /* -- sr_recv_stamped -- */
+
+int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+{
+    struct sr_vns_rx* rx = 0;
+    uint8_t* pkts[SR_VNS_RX_BURST];
+    unsigned int lens[SR_VNS_RX_BURST];
+    struct sr_if* ifaces[SR_VNS_RX_BURST];
+    unsigned int n = 0;
+    int handled = 0;
+    int command, len, ret;
+    uint8_t* buf;
+    unsigned long frames;
+
+    /* REQUIRES */
+    assert(sr);
+
+    rx = &(sr->rx);
+    frames = rx->frames;
+    if ( !rx->buf && (rx->buf = (uint8_t*)malloc(SR_VNS_RX_SIZE)) == 0 )
+    {
+        fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
+        return -1;
+    }
+
+    while ( !handled )
+    {
+        /*-----------------------------------------------------------------------
+          Handle every complete command already read; while connecting,
+          exactly one is expected per call
+          ---------------------------------------------------------------------*/
+
+        while ( !(expected_cmd && handled) && rx->tail - rx->head >= 8 )
+        {
+            buf = rx->buf + rx->head;
+            memcpy(&len, buf, 4);
+            len = ntohl(len);
+
+            if ( len > 10000 || len < 8 )
+            {
+                fprintf(stderr,"Error: command length to large %d\n",len);
+                close(sr->sockfd);
+                return -1;
+            }
+            if ( rx->tail - rx->head < (unsigned int)len )
+            { break; }
+
+            /* -- handlers read the type in host order -- */
+            memcpy(&command, buf + 4, 4);
+            command = ntohl(command);
+            memcpy(buf + 4, &command, 4);
+
+            /* make sure the command is what we expected if we were expecting something */
+            if(expected_cmd && command!=expected_cmd) {
+                if(command != VNSCLOSE) { /* VNSCLOSE is always ok */
+                    fprintf(stderr, "Error: expected command %d but got %d\n", expected_cmd, command);
+                    return -1;
+                }
+            }
+
+            rx->head += len;
+            handled = 1;
+
+            if ( command == VNSPACKET )
+            {
+                sr_rx_packet(sr, buf, len, pkts, lens, ifaces, &n);
+                if ( n == SR_VNS_RX_BURST )
+                {
+                    sr_handlepacket_burst(sr, pkts, lens, ifaces, n);
+                    n = 0;
+                }
+                continue;
+            }
+
+            /* -- frames that arrived before this command go first -- */
+            sr_handlepacket_burst(sr, pkts, lens, ifaces, n);
+            n = 0;
+
+            if ( (ret = sr_handle_command(sr, buf, command)) != 1 )
+            {
+                sr_tx_return_lent(&(sr->tx));
+                return ret;
+            }
+        }
+
+        sr_handlepacket_burst(sr, pkts, lens, ifaces, n);
+        n = 0;
+        if ( handled )
+        { break; }
+
+        /* -- SIGINT: main() tears down once the loop returns -- */
+        if ( sr->quit )
+        { return 0; }
+
+        /*-----------------------------------------------------------------------
+          Move a partial command to the front and read as much as the
+          socket holds
+          ---------------------------------------------------------------------*/
+
+        if ( rx->head )
+        {
+            memmove(rx->buf, rx->buf + rx->head, rx->tail - rx->head);
+            rx->tail -= rx->head;
+            rx->head = 0;
+        }
+
+        if ( sr->tx.uring )
+        {
+            ret = sr_uring_recv(sr->tx.uring, rx->buf + rx->tail,
+                                SR_VNS_RX_SIZE - rx->tail);
+            rx->stamp = sr_busypoll_now();
+        }
+        else do
+        { /* -- just in case SIGALRM breaks recv -- */
+            errno = 0; /* -- hacky glibc workaround -- */
+            rx->syscalls++;
+            ret = sr_recv_stamped(sr->sockfd, rx->buf + rx->tail,
+                                  SR_VNS_RX_SIZE - rx->tail, &(rx->stamp));
+        } while ( ret == -1 && errno == EINTR && !sr->quit ); /* be mindful of signals */
+
+        if ( ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+        {
+            if ( sr->busy.idle_us )
+            {
+                if ( sr_tx_flush(&(sr->tx)) != 0 )
+                { return -1; }
+                sr_busypoll_idle(&(sr->busy));
+                continue;
+            }
+            if ( sr_tx_wait(&(sr->tx)) != 0 )
+            { return -1; }
+            sr->busy.wakeups++;
+            continue;
+        }
+        if ( ret == -1 && errno == EINTR )
+        { continue; }
+        if ( ret == -1 )
+        {
+            perror("recv(..):sr_client.c::sr_read_from_server");
+            return -1;
+        }
+        if ( ret == 0 )
+        {
+            fprintf(stderr,"Error: VNS server closed the connection\n");
+            return -1;
+        }
+        rx->tail += ret;
+        rx->reads++;
+        sr_busypoll_work(&(sr->busy));
+    }
+
+    /* -- everything the commands produced goes out together, what the
+          socket did not take must not stay in the receive buffer -- */
+    if ( sr_tx_flush(&(sr->tx)) != 0 || sr_tx_return_lent(&(sr->tx)) != 0 )
+    { return -1; }
+
+    /* -- workers time the frames they handle themselves -- */
+    if ( rx->frames > frames && !sr->workers )
+    {
+        sr_lat_add(&(sr->busy.lat), sr_busypoll_now() - rx->stamp,
+                   rx->frames - frames);
+    }
+    return 1;
 }/* -- sr_read_from_server -- */
 
 /*-----------------------------------------------------------------------------
@@ -517,23 +709,16 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 static int
 sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
                                 uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
+                                const struct sr_if* iface /* borrowed */ )
 {
     struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(sr);
     assert(buf);
-    assert(name);
+    assert(iface);
 
     ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
-
-    if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
-    }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
         fprintf( stderr, "** Error, source address does not match interface\n");
@@ -562,51 +747,168 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
-                         const char* iface /* borrowed */)
+                         const char* name /* borrowed */)
 {
-    c_packet_header *sr_pkt;
-    unsigned int total_len =  len + (sizeof(c_packet_header));
+    struct sr_if* iface;
 
     /* REQUIRES */
     assert(sr);
     assert(buf);
-    assert(iface);
+    assert(name);
+
+    iface = sr_get_interface(sr, name);
+    if ( iface == 0 ){
+        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
+        return -1;
+    }
+
+    return sr_send_packet_if(sr, buf, len, iface);
+} /* -- sr_send_packet -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_check(..)
+ * Scope: Local
+ *
+ * Checks and logs a frame about to be sent.  Returns 0 if it may go.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_send_check(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const struct sr_if* iface /* borrowed */)
+{
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) ){
         fprintf(stderr , "** Error: packet is wayy to short \n");
         return -1;
     }
 
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
-
     /* -- log packet -- */
     sr_log_packet(sr,buf,len);
 
     if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
         fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
         return -1;
     }
+    return 0;
+} /* -- sr_send_check -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_if(..)
+ * Scope: Global
+ *
+ * Same as sr_send_packet(..) for an interface that is already resolved.
+ * The frame is checked and put on the interface's transmit queue, or
+ * its transmit ring when running on real interfaces, and goes out on
+ * the next flush; buf may be reused on return.
+ *
+ * Nothing is copied for the queue when it can be avoided.  A worker's
+ * own frame changes hands, a frame rewritten in the receive buffer is
+ * lent until the reader is done with the buffer (sr_tx_enqueue_lent),
+ * only any other frame is copied.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_if(struct sr_instance* sr /* borrowed */,
+                      uint8_t* buf /* borrowed */ ,
+                      unsigned int len,
+                      const struct sr_if* iface /* borrowed */)
+{
+    struct sr_worker* w;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+
+    if ( sr_send_check(sr, buf, len, iface) != 0 )
+    { return -1; }
+
+    w = sr_worker_self();
+
+    /* -- in a pipeline the workers leave the writing to the writer -- */
+    if ( sr->writer && w )
+    { return sr_writer_send(sr, w, buf, len, iface); }
+
+    if ( sr->afp )
+    { return sr_afpacket_send(sr->afp, iface, buf, len); }
+
+    if ( w && sr_worker_take(w, buf) )
+    { return sr_tx_give(&(sr->tx), iface, buf, len); }
+    if ( sr->rx.buf && buf >= sr->rx.buf + SR_PACKET_HEADROOM &&
+         buf < sr->rx.buf + SR_VNS_RX_SIZE )
+    { return sr_tx_enqueue_lent(&(sr->tx), iface, buf, len); }
+    return sr_tx_enqueue(&(sr->tx), iface, buf, len);
+} /* -- sr_send_packet_if -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_buf(..)
+ * Scope: Global
+ *
+ * sr_send_packet_if(..) for a frame from sr_packet_alloc(..), whose
+ * buffer goes with it: it is queued as is, VNS header in its headroom,
+ * and freed once sent or dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_buf(struct sr_instance* sr /* borrowed */,
+                       uint8_t* buf /* given */ ,
+                       unsigned int len,
+                       const struct sr_if* iface /* borrowed */)
+{
+    struct sr_worker* w;
+    int ret;
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+
+    if ( sr_send_check(sr, buf, len, iface) != 0 )
+    {
+        sr_packet_free(buf);
         return -1;
     }
 
-    free(sr_pkt);
+    if ( sr->writer && (w = sr_worker_self()) )
+    {
+        sr_writer_push(sr, w, buf, len, iface);
+        return 0;
+    }
 
-    return 0;
-} /* -- sr_send_packet -- */
+    if ( sr->afp )
+    {
+        ret = sr_afpacket_send(sr->afp, iface, buf, len);
+        sr_packet_free(buf);
+        return ret;
+    }
+    return sr_tx_give(&(sr->tx), iface, buf, len);
+} /* -- sr_send_packet_buf -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_packet_alloc(..)
+ * Scope: Global
+ *
+ * Allocate room for a frame of 'len' bytes with SR_PACKET_HEADROOM in
+ * front of it from the buffer pool.  Release with sr_packet_free(..).
+ *
+ *---------------------------------------------------------------------------*/
+
+uint8_t* sr_packet_alloc(unsigned int len)
+{
+    uint8_t* mem = (uint8_t*)sr_mbuf_get(SR_PACKET_HEADROOM + len);
+
+    if(!mem)
+    { return 0; }
+    return mem + SR_PACKET_HEADROOM;
+} /* -- sr_packet_alloc -- */
+
+void sr_packet_free(uint8_t* buf)
+{
+    if(buf)
+    { sr_mbuf_put(buf - SR_PACKET_HEADROOM); }
+} /* -- sr_packet_free -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
@@ -616,23 +918,14 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
 
 void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 {
-    struct pcap_pkthdr h;
-    int size;
-
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
+    if(!sr->pcaplog)
     {return; }
 
-    size = min(PACKET_DUMP_SIZE, len);
-
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
-
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    /* -- the log thread does the writing, any thread may get here -- */
+    sr_pcaplog_add(sr->pcaplog, buf, len);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
@@ -644,9 +937,8 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface  /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arp_hdr*       a_hdr = 0;
 
@@ -0,0 +1,368 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Forwarding worker threads fed through frame rings.  See sr_worker.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <assert.h>
+
+#include "sr_worker.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_afpacket.h"
+#include "sr_fib.h"
+#include "sr_writer.h"
+
+static __thread struct sr_worker* sr_worker_current;
+
+struct sr_worker* sr_worker_self(void)
+{
+    return sr_worker_current;
+} /* -- sr_worker_self -- */
+
+int sr_worker_take(struct sr_worker* w, uint8_t* frame)
+{
+    unsigned int i;
+
+    for(i = 0; i < w->nburst; i++)
+    {
+        if(w->burst[i] == frame)
+        {
+            w->burst[i] = 0;
+            return 1;
+        }
+    }
+    return 0;
+} /* -- sr_worker_take -- */
+
+/* makes the frames pushed so far visible to w */
+static void sr_worker_publish(struct sr_worker* w)
+{
+    if(sr_ring_publish(&(w->ring)))
+    { sr_bell_ring(&(w->bell)); }
+} /* -- sr_worker_publish -- */
+
+static void sr_worker_flush(struct sr_instance* sr, struct sr_worker* w)
+{
+    if(sr->writer)
+    {
+        sr_writer_kick(sr, w);
+        return;
+    }
+
+    if(sr->afp)
+    { sr_afpacket_flush(sr->afp); }
+    else
+    { sr_tx_flush(&(sr->tx)); }
+
+    /* -- an io_uring send only completes once the reader reaps it -- */
+    if(sr->tx.uring && sr->tx.inflight)
+    { sched_yield(); }
+} /* -- sr_worker_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_main(..)
+ * Scope:  Local
+ *
+ * Takes up to a burst of frames off the ring at a time, handles them
+ * and returns the buffers the writer did not take.  Output is flushed
+ * every SR_WORKER_FLUSH frames and whenever the ring runs dry.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_worker_main(void* arg)
+{
+    struct sr_worker* w = (struct sr_worker*)arg;
+    struct sr_instance* sr = w->sr;
+    unsigned int lens[SR_VNS_RX_BURST];
+    struct sr_if* ifaces[SR_VNS_RX_BURST];
+    uint64_t stamps[SR_WORKER_FLUSH];
+    unsigned int avail, seq, n, i, unflushed = 0;
+    uint64_t now;
+
+    sr_worker_current = w;
+
+    while(!sr->workers->stop)
+    {
+        avail = sr_ring_avail(&(w->ring));
+        if(avail == 0 || unflushed == SR_WORKER_FLUSH)
+        {
+            if(unflushed)
+            {
+                sr_worker_flush(sr, w);
+                now = sr_busypoll_now();
+                for(i = 0; i < unflushed; i++)
+                { sr_lat_add(&(w->busy.lat), now - stamps[i], 1); }
+                unflushed = 0;
+                continue;
+            }
+            if(w->busy.idle_us)
+            {
+                sr_busypoll_idle(&(w->busy));
+                continue;
+            }
+            seq = sr_bell_arm(&(w->bell));
+            if(sr_ring_avail(&(w->ring)) == 0 && !sr->workers->stop)
+            { sr_bell_wait(&(w->bell), seq); }
+            else
+            { sr_bell_disarm(&(w->bell)); }
+            continue;
+        }
+        sr_busypoll_work(&(w->busy));
+
+        n = avail;
+        if(n > SR_VNS_RX_BURST)
+        { n = SR_VNS_RX_BURST; }
+        if(n > SR_WORKER_FLUSH - unflushed)
+        { n = SR_WORKER_FLUSH - unflushed; }
+        for(i = 0; i < n; i++)
+        {
+            struct sr_ring_slot* s = sr_ring_peek(&(w->ring), i);
+            w->burst[i] = s->frame;
+            lens[i] = s->len;
+            ifaces[i] = s->iface;
+            stamps[unflushed + i] = s->stamp;
+        }
+        w->nburst = n;
+
+        sr_handlepacket_burst(sr, w->burst, lens, ifaces, n);
+
+        for(i = 0; i < n; i++)
+        {
+            if(w->burst[i])
+            { sr_packet_free(w->burst[i]); }
+        }
+        w->nburst = 0;
+        sr_ring_pop(&(w->ring), n);
+        unflushed += n;
+        w->frames += n;
+        w->bursts++;
+    }
+
+    if(unflushed)
+    { sr_worker_flush(sr, w); }
+    return 0;
+} /* -- sr_worker_main -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_worker_hash(..)
+ * Scope:  Local
+ *
+ * Flow hash of an IPv4 frame; 0 for anything else.  Fragments leave
+ * the ports out, only the first one carries them.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_worker_hash(const uint8_t* frame, unsigned int len)
+{
+    const sr_ip_hdr_t* ip;
+    unsigned int hl;
+    uint32_t h, ports;
+
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+       ethertype((uint8_t*)frame) != ethertype_ip)
+    { return 0; }
+
+    ip = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    h = ip->ip_src * 2654435761u;
+    h = (h ^ ip->ip_dst) * 2654435761u;
+    h = (h ^ ip->ip_p) * 2654435761u;
+
+    hl = ip->ip_hl * 4;
+    if((ip->ip_p == 6 || ip->ip_p == 17) &&
+       !(ntohs(ip->ip_off) & (IP_MF | IP_OFFMASK)) &&
+       len >= sizeof(sr_ethernet_hdr_t) + hl + sizeof(ports))
+    {
+        memcpy(&ports, (const uint8_t*)ip + hl, sizeof(ports));
+        h = (h ^ ports) * 2654435761u;
+    }
+    return h ^ (h >> 16);
+} /* -- sr_worker_hash -- */
+
+/* only the reader may reap io_uring completions, so it retires the
+   workers' finished sends and starts the next batch */
+static void sr_workers_reap(struct sr_instance* sr)
+{
+    if(sr->tx.uring)
+    { sr_tx_flush(&(sr->tx)); }
+} /* -- sr_workers_reap -- */
+
+void sr_workers_dispatch(struct sr_instance* sr, uint8_t** packets,
+                         unsigned int* lens, struct sr_if** ifaces,
+                         unsigned int n)
+{
+    struct sr_workers* ws = sr->workers;
+    struct sr_worker* w;
+    uint64_t stamp;
+    unsigned int i;
+    uint8_t* frame;
+
+    if(n == 0)
+    { return; }
+
+    /* -- VNS frames carry their read's time, ring frames the hand over -- */
+    stamp = sr->afp ? sr_busypoll_now() : sr->rx.stamp;
+
+    for(i = 0; i < n; i++)
+    {
+        w = ws->w[ws->num > 1 ? sr_worker_hash(packets[i], lens[i]) % ws->num : 0];
+
+        /* -- a full ring holds the reader back, the socket or the
+              kernel ring keeps the rest -- */
+        while(sr_ring_room(&(w->ring)) == 0)
+        {
+            sr_worker_publish(w);
+            sr_workers_reap(sr);
+            w->ring.stalls++;
+            sched_yield();
+        }
+        if((frame = sr_packet_alloc(lens[i])) == 0)
+        {
+            w->drops++;
+            continue;
+        }
+        memcpy(frame, packets[i], lens[i]);
+        sr_ring_push(&(w->ring), frame, lens[i], ifaces[i], stamp, 0);
+    }
+
+    for(i = 0; i < ws->num; i++)
+    { sr_worker_publish(ws->w[i]); }
+    sr_workers_reap(sr);
+} /* -- sr_workers_dispatch -- */
+
+int sr_workers_start(struct sr_instance* sr, unsigned int n)
+{
+    struct sr_workers* ws;
+    struct sr_worker* w;
+    sigset_t all, old;
+    unsigned int i;
+    int err;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(n > SR_WORKER_MAX)
+    { n = SR_WORKER_MAX; }
+
+    /* -- the workers share one fib, built before any of them looks -- */
+    if(!sr->fib && (sr->fib = sr_fib_build(sr->routing_table)) == 0)
+    {
+        fprintf(stderr, "Error: no fib for the workers\n");
+        return -1;
+    }
+
+    if((ws = (struct sr_workers*)calloc(1, sizeof(struct sr_workers))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_workers_start)\n");
+        return -1;
+    }
+    sr->workers = ws;
+
+    /* -- signals stay with the main thread, whose handler joins these -- */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for(i = 0; i < n; i++)
+    {
+        if((w = (struct sr_worker*)calloc(1, sizeof(struct sr_worker))) == 0)
+        { break; }
+        w->sr = sr;
+        w->id = i;
+        sr_ring_init(&(w->ring));
+        sr_ring_init(&(w->out));
+        sr_rtcache_init(&(w->rtcache));
+        sr_busypoll_init(&(w->busy), sr->busy.idle_us);
+        ws->w[ws->num] = w;
+
+        if((err = pthread_create(&(w->thread), 0, sr_worker_main, w)) != 0)
+        {
+            fprintf(stderr, "Error: cannot start worker %u: %s\n", i, strerror(err));
+            free(w);
+            ws->w[ws->num] = 0;
+            break;
+        }
+        ws->num++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    if(ws->num == 0)
+    {
+        free(ws);
+        sr->workers = 0;
+        return -1;
+    }
+    printf("Forwarding on %u worker threads\n", ws->num);
+    return 0;
+} /* -- sr_workers_start -- */
+
+void sr_workers_stop(struct sr_instance* sr)
+{
+    struct sr_workers* ws = sr->workers;
+    struct sr_worker* w;
+    unsigned int i, b, n;
+
+    if(!ws || ws->stop)
+    { return; }
+
+    ws->stop = 1;
+    for(i = 0; i < ws->num; i++)
+    {
+        w = ws->w[i];
+        sr_bell_ring(&(w->bell));
+        pthread_join(w->thread, 0);
+
+        /* -- frames never taken off the ring -- */
+        for(n = sr_ring_avail(&(w->ring)); n > 0; n--)
+        {
+            sr_packet_free(sr_ring_peek(&(w->ring), 0)->frame);
+            sr_ring_pop(&(w->ring), 1);
+        }
+
+        sr->stats.ip_too_short += w->stats.ip_too_short;
+        sr->stats.ip_bad_hdr += w->stats.ip_bad_hdr;
+        sr->stats.ip_bad_len += w->stats.ip_bad_len;
+        sr->stats.ip_bad_cksum += w->stats.ip_bad_cksum;
+        sr->rtcache.hits += w->rtcache.hits;
+        sr->rtcache.misses += w->rtcache.misses;
+        for(b = 0; b < SR_LAT_BUCKETS; b++)
+        { sr->busy.lat.count[b] += w->busy.lat.count[b]; }
+        sr->busy.lat.total += w->busy.lat.total;
+    }
+} /* -- sr_workers_stop -- */
+
+void sr_workers_destroy(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    if(!sr->workers)
+    { return; }
+    sr_workers_stop(sr);
+    for(i = 0; i < sr->workers->num; i++)
+    { free(sr->workers->w[i]); }
+    free(sr->workers);
+    sr->workers = 0;
+} /* -- sr_workers_destroy -- */
+
+void sr_workers_dump_stats(struct sr_instance* sr)
+{
+    struct sr_worker* w;
+    unsigned int i;
+
+    fprintf(stderr, "forwarding workers:\n");
+    for(i = 0; i < sr->workers->num; i++)
+    {
+        w = sr->workers->w[i];
+        fprintf(stderr, "  %u: %lu frames in %lu bursts, ring max depth %u, %lu full, dropped %lu, %lu sleeps, %lu wakes, route cache hits %lu misses %lu\n",
+                w->id, w->frames, w->bursts, w->ring.max_depth, w->ring.stalls,
+                w->drops, w->bell.waits, w->bell.rings,
+                w->rtcache.hits, w->rtcache.misses);
+    }
+} /* -- sr_workers_dump_stats -- */
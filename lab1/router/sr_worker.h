@@ -0,0 +1,98 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_worker.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Forwarding on several cores.  With -w N the thread reading the VNS
+ * socket or the AF_PACKET rings only receives: sr_handlepacket_burst()
+ * copies each frame into a pool buffer and pushes it onto the ring of
+ * one of N worker threads, which run the bursts and flush the transmit
+ * side themselves.  The worker is picked by a hash of source and
+ * destination address, protocol and, for unfragmented TCP and UDP, the
+ * ports, so the frames of a flow stay in order.  Other frames, ARP
+ * included, go to worker 0.
+ *
+ * Each worker's ring (sr_ring) has one producer and one consumer and
+ * needs no lock; the reader publishes once per burst.  A full ring
+ * makes the reader wait for room rather than drop, leaving the backlog
+ * in the socket or kernel ring.  An idle worker busy polls like the
+ * reader when -B is given, otherwise it sleeps on its bell and the
+ * reader rings it.  With a writer thread (sr_writer) the workers hand
+ * their output over through a second ring instead of writing.
+ *
+ * The fib, the adjacencies, the interfaces and the ARP cache are shared.
+ * The routing table must not change once the workers run.  Drop
+ * counters, the route cache and the latency histogram are kept per
+ * worker; sr_workers_stop() adds them to the router's own.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WORKER_H
+#define SR_WORKER_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_router.h"
+#include "sr_ring.h"
+
+#define SR_WORKER_MAX      16
+#define SR_WORKER_FLUSH    64    /* frames handled between flushes */
+
+struct sr_worker
+{
+    struct sr_ring ring;        /* frames from the reader */
+    struct sr_ring out;         /* frames for the writer, with -P */
+    struct sr_bell bell;        /* the worker sleeps on ring */
+    struct sr_instance* sr;
+    unsigned int id;
+    pthread_t thread;
+    uint8_t* burst[SR_VNS_RX_BURST];    /* frames being handled, 0 once
+                                           handed to the writer */
+    unsigned int nburst;
+    unsigned long drops;        /* no buffer for the copy, by the reader */
+    unsigned long frames;       /* handled by the worker */
+    unsigned long bursts;
+    unsigned long copies;       /* built frames copied for the writer */
+    struct sr_router_stats stats;
+    struct sr_rtcache rtcache;
+    struct sr_busypoll busy;
+};
+
+struct sr_workers
+{
+    struct sr_worker* w[SR_WORKER_MAX];
+    unsigned int num;
+    volatile int stop;
+};
+
+/* Starts n workers on sr.  Returns 0, or -1 if none could be started. */
+int  sr_workers_start(struct sr_instance* sr, unsigned int n);
+
+/* Stops and joins the workers and adds their counters to sr's. */
+void sr_workers_stop(struct sr_instance* sr);
+void sr_workers_destroy(struct sr_instance* sr);
+
+/* Hands n received frames to the workers; called by the reader. */
+void sr_workers_dispatch(struct sr_instance* sr, uint8_t** packets,
+                         unsigned int* lens, struct sr_if** ifaces,
+                         unsigned int n);
+
+/* The worker the calling thread is, or 0 for any other thread. */
+struct sr_worker* sr_worker_self(void);
+
+/* Takes frame's buffer off w's burst if it is one of the frames being
+   handled, so it is not freed after the burst.  Returns 1 if it was. */
+int  sr_worker_take(struct sr_worker* w, uint8_t* frame);
+
+void sr_workers_dump_stats(struct sr_instance* sr);
+
+#endif /* -- SR_WORKER_H -- */
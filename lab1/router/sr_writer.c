@@ -0,0 +1,240 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_writer.c
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Writer thread at the end of the forwarding pipeline.  See sr_writer.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <poll.h>
+#include <assert.h>
+
+#include "sr_writer.h"
+#include "sr_worker.h"
+#include "sr_router.h"
+#include "sr_afpacket.h"
+
+int sr_writer_send(struct sr_instance* sr, struct sr_worker* w,
+                   uint8_t* frame, unsigned int len,
+                   const struct sr_if* iface)
+{
+    uint8_t* buf = frame;
+
+    /* -- a frame being handled changes hands, anything else is copied -- */
+    if(!sr_worker_take(w, frame))
+    {
+        if((buf = sr_packet_alloc(len)) == 0)
+        { return -1; }
+        memcpy(buf, frame, len);
+        w->copies++;
+    }
+    sr_writer_push(sr, w, buf, len, iface);
+    return 0;
+} /* -- sr_writer_send -- */
+
+void sr_writer_push(struct sr_instance* sr, struct sr_worker* w,
+                    uint8_t* frame, unsigned int len,
+                    const struct sr_if* iface)
+{
+    while(sr_ring_room(&(w->out)) == 0)
+    {
+        sr_writer_kick(sr, w);
+        w->out.stalls++;
+        sched_yield();
+    }
+    sr_ring_push(&(w->out), frame, len, (struct sr_if*)iface, 0, 0);
+} /* -- sr_writer_push -- */
+
+void sr_writer_kick(struct sr_instance* sr, struct sr_worker* w)
+{
+    if(sr_ring_publish(&(w->out)))
+    { sr_bell_ring(&(sr->writer->bell)); }
+} /* -- sr_writer_kick -- */
+
+/* frames waiting on any out-ring or, for the socket, on the queues */
+static int sr_writer_pending(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    for(i = 0; i < sr->workers->num; i++)
+    {
+        if(sr_ring_avail(&(sr->workers->w[i]->out)))
+        { return 1; }
+    }
+    return !sr->afp && sr->tx.queued > 0;
+} /* -- sr_writer_pending -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_writer_drain(..)
+ * Scope:  Local
+ *
+ * Moves the frames on the workers' out-rings to the transmit side,
+ * then writes them.  Returns the number of frames moved; stops at a
+ * full transmit queue and leaves the rest for the next pass.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_writer_drain(struct sr_writer* wr)
+{
+    struct sr_instance* sr = wr->sr;
+    struct sr_worker* w;
+    struct sr_ring_slot* s;
+    unsigned int i, n, avail, moved = 0;
+
+    for(i = 0; i < sr->workers->num; i++)
+    {
+        w = sr->workers->w[i];
+        avail = sr_ring_avail(&(w->out));
+        for(n = 0; n < avail; n++)
+        {
+            s = sr_ring_peek(&(w->out), n);
+            if(sr->afp)
+            {
+                sr_afpacket_send(sr->afp, s->iface, s->frame, s->len);
+                sr_packet_free(s->frame);
+            }
+            else if(sr_tx_enqueue_buf(&(sr->tx), s->iface, s->frame, s->len) != 0)
+            {
+                wr->full++;
+                break;
+            }
+        }
+        sr_ring_pop(&(w->out), n);
+        moved += n;
+    }
+
+    if(sr->afp)
+    { sr_afpacket_flush(sr->afp); }
+    else
+    { sr_tx_flush(&(sr->tx)); }
+
+    wr->frames += moved;
+    if(moved)
+    { wr->batches++; }
+    return moved;
+} /* -- sr_writer_drain -- */
+
+static void* sr_writer_main(void* arg)
+{
+    struct sr_writer* wr = (struct sr_writer*)arg;
+    struct sr_instance* sr = wr->sr;
+    struct pollfd pfd;
+    unsigned int seq;
+
+    pthread_mutex_lock(&(sr->tx.lock));
+    sr->tx.writer = pthread_self();
+    sr->tx.kick = &(wr->bell);
+    pthread_mutex_unlock(&(sr->tx.lock));
+
+    while(!wr->stop)
+    {
+        if(sr_writer_drain(wr))
+        { continue; }
+
+        /* -- a full socket: wait for room rather than spin -- */
+        if(!sr->afp && sr->tx.queued > 0)
+        {
+            pfd.fd = sr->tx.fd;
+            pfd.events = POLLOUT;
+            wr->polls++;
+            poll(&pfd, 1, SR_WRITER_WAIT_MS);
+            continue;
+        }
+
+        seq = sr_bell_arm(&(wr->bell));
+        if(!sr_writer_pending(sr) && !wr->stop)
+        { sr_bell_wait(&(wr->bell), seq); }
+        else
+        { sr_bell_disarm(&(wr->bell)); }
+    }
+
+    /* -- the workers are gone, send what they left behind -- */
+    while(sr_writer_drain(wr))
+    { }
+    return 0;
+} /* -- sr_writer_main -- */
+
+int sr_writer_start(struct sr_instance* sr)
+{
+    struct sr_writer* wr;
+    sigset_t all, old;
+    int err;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(sr->workers);
+
+    if((wr = (struct sr_writer*)calloc(1, sizeof(struct sr_writer))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_writer_start)\n");
+        return -1;
+    }
+    wr->sr = sr;
+    sr->writer = wr;
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    err = pthread_create(&(wr->thread), 0, sr_writer_main, wr);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    if(err != 0)
+    {
+        fprintf(stderr, "Error: cannot start the writer: %s\n", strerror(err));
+        sr->writer = 0;
+        free(wr);
+        return -1;
+    }
+    printf("Writing on a separate thread\n");
+    return 0;
+} /* -- sr_writer_start -- */
+
+void sr_writer_stop(struct sr_instance* sr)
+{
+    struct sr_writer* wr = sr->writer;
+
+    if(!wr || wr->stop)
+    { return; }
+
+    wr->stop = 1;
+    sr_bell_ring(&(wr->bell));
+    pthread_join(wr->thread, 0);
+
+    /* -- from here on whoever flushes writes -- */
+    pthread_mutex_lock(&(sr->tx.lock));
+    sr->tx.kick = 0;
+    pthread_mutex_unlock(&(sr->tx.lock));
+} /* -- sr_writer_stop -- */
+
+void sr_writer_destroy(struct sr_instance* sr)
+{
+    if(!sr->writer)
+    { return; }
+    sr_writer_stop(sr);
+    free(sr->writer);
+    sr->writer = 0;
+} /* -- sr_writer_destroy -- */
+
+void sr_writer_dump_stats(struct sr_instance* sr)
+{
+    struct sr_writer* wr = sr->writer;
+    struct sr_worker* w;
+    unsigned int i;
+
+    fprintf(stderr, "writer:\n");
+    fprintf(stderr, "  %lu frames in %lu batches, %lu queue full, %lu socket waits, %lu sleeps, %lu wakes\n",
+            wr->frames, wr->batches, wr->full, wr->polls,
+            wr->bell.waits, wr->bell.rings);
+    for(i = 0; i < sr->workers->num; i++)
+    {
+        w = sr->workers->w[i];
+        fprintf(stderr, "  from %u: out ring max depth %u, %lu full, copied %lu\n",
+                w->id, w->out.max_depth, w->out.stalls, w->copies);
+    }
+} /* -- sr_writer_dump_stats -- */
@@ -0,0 +1,86 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_writer.h
+ * date:  Fri Oct 16 2026
+ *
+ * Description:
+ *
+ * Output stage of the forwarding pipeline.  With -P the router runs as
+ * three stages: the reader hands frames to the workers (sr_worker), the
+ * workers rewrite them and a single writer thread sends them.
+ *
+ * A worker does not copy a frame it forwards: the pool buffer it got
+ * off its in-ring goes onto its out-ring (worker->out) as is, and the
+ * writer links it, VNS header in its headroom, onto the transmit queue
+ * (sr_tx_enqueue_buf).  Frames a worker builds itself, ICMP errors and
+ * ARP requests, change hands the same way (sr_writer_push); only frames
+ * the worker does not own, ones queued on ARP, are copied first.  A full out-ring makes
+ * the worker wait for room, a full transmit queue leaves the frames on
+ * the out-ring, so backpressure reaches the reader and the socket.
+ *
+ * Once the writer runs it is the only thread writing the VNS socket;
+ * flushes from the ARP cache thread ring its bell (sr_tx).  On an
+ * AF_PACKET router it fills the transmit rings instead.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_WRITER_H
+#define SR_WRITER_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_ring.h"
+
+#define SR_WRITER_WAIT_MS  100   /* longest wait for a full socket */
+
+struct sr_instance;
+struct sr_if;
+struct sr_worker;
+
+struct sr_writer
+{
+    struct sr_instance* sr;
+    pthread_t thread;
+    struct sr_bell bell;        /* the writer sleeps on the out-rings */
+    volatile int stop;
+    unsigned long frames;       /* taken off the out-rings */
+    unsigned long batches;      /* passes that found frames */
+    unsigned long full;         /* passes cut short by a full queue */
+    unsigned long polls;        /* waits for a full socket */
+};
+
+/* Starts the writer on sr, whose workers must be running.  Returns 0 or
+   -1. */
+int  sr_writer_start(struct sr_instance* sr);
+
+/* Sends what the workers have left, then stops the writer.  Call after
+   sr_workers_stop(). */
+void sr_writer_stop(struct sr_instance* sr);
+void sr_writer_destroy(struct sr_instance* sr);
+
+/* Queues frame on the calling worker's out-ring, taking its buffer when
+   it is one of the frames being handled.  Returns 0, or -1 if a copy
+   found no buffer. */
+int  sr_writer_send(struct sr_instance* sr, struct sr_worker* w,
+                    uint8_t* frame, unsigned int len,
+                    const struct sr_if* iface);
+
+/* Queues the pool buffer frame, allocated with sr_packet_alloc(), on the
+   calling worker's out-ring; the writer frees it once sent. */
+void sr_writer_push(struct sr_instance* sr, struct sr_worker* w,
+                    uint8_t* frame, unsigned int len,
+                    const struct sr_if* iface);
+
+/* Makes w's queued frames visible to the writer and wakes it. */
+void sr_writer_kick(struct sr_instance* sr, struct sr_worker* w);
+
+void sr_writer_dump_stats(struct sr_instance* sr);
+
+#endif /* -- SR_WRITER_H -- */
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+"""
+file:  vns_bench.py
+date:  Fri Oct 16 2026
+
+Description:
+
+Compares the router's two VNS transports, epoll and io_uring (-U), on
+forwarding throughput and on system calls per frame.  "make uring_bench"
+runs it after building sr; run it from lab1/router, where sr, rtable and
+auth_key are.
+
+The script stands in for the VNS server.  For each transport it starts
+./sr against itself and authenticates it.  It gives it the three
+interfaces the rtable in this directory expects and answers its ARP
+requests for 172.64.3.10 on eth2.  It then streams small UDP frames from
+10.0.1.100 on eth3 to 172.64.3.10, never more than --window frames ahead
+of what has come back out on eth2.  pps is what came back out divided by
+the time taken.  Syscalls per frame is the "VNS syscalls" line the
+router prints on exit; it counts recv, writev, epoll and io_uring_enter
+calls over all frames received and sent.  Each transport is run --runs
+times and the median pps is reported.
+
+A kernel without io_uring makes sr fall back to epoll; the io_uring row
+is then marked as such.
+
+Usage: vns_bench.py [--frames N] [--window N] [--runs N] [-- sr options]
+"""
+
+import argparse
+import re
+import select
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+VNS_PACKET, VNS_CLOSE, VNS_HWINFO = 4, 2, 16
+VNS_AUTH_REQUEST, VNS_AUTH_STATUS = 128, 512
+
+IFACES = [("eth1", bytes.fromhex("0a0000000001"), "192.168.2.1"),
+          ("eth2", bytes.fromhex("0a0000000002"), "172.64.3.1"),
+          ("eth3", bytes.fromhex("0a0000000003"), "10.0.1.1")]
+HOST2 = bytes.fromhex("020000000102")   # 172.64.3.10, next hop on eth2
+HOST3 = bytes.fromhex("020000000103")   # 10.0.1.100, sender on eth3
+BURST = 256                             # frames per sendall()
+
+
+def ip(s):
+    return socket.inet_aton(s)
+
+
+def cksum(b):
+    s = sum(struct.unpack("!%dH" % (len(b) // 2), b))
+    while s >> 16:
+        s = (s & 0xffff) + (s >> 16)
+    return ~s & 0xffff
+
+
+def udp_frame():
+    payload = b"x" * 18
+    h = struct.pack("!BBHHHBBH4s4s", 0x45, 0, 20 + 8 + len(payload), 1, 0, 64,
+                    17, 0, ip("10.0.1.100"), ip("172.64.3.10"))
+    h = h[:10] + struct.pack("!H", cksum(h)) + h[12:]
+    udp = struct.pack("!HHHH", 5000, 5001, 8 + len(payload), 0) + payload
+    return IFACES[2][1] + HOST3 + b"\x08\x00" + h + udp
+
+
+def arp_reply():
+    eth2 = IFACES[1][1]
+    body = struct.pack("!HHBBH6s4s6s4s", 1, 0x800, 6, 4, 2, HOST2,
+                       ip("172.64.3.10"), eth2, ip("172.64.3.1"))
+    return eth2 + HOST2 + b"\x08\x06" + body
+
+
+def vns_msg(mtype, body):
+    return struct.pack("!II", 8 + len(body), mtype) + body
+
+
+def vns_packet(iface, frame):
+    return vns_msg(VNS_PACKET, iface.encode().ljust(16, b"\0") + frame)
+
+
+class Server:
+    """One VNS session with the router."""
+
+    def __init__(self, sock):
+        self.s = sock
+        self.buf = b""
+        self.lock = threading.Lock()
+
+    def send(self, data):
+        with self.lock:
+            self.s.sendall(data)
+
+    def recv(self, timeout):
+        end = time.time() + timeout
+        while True:
+            if len(self.buf) >= 8:
+                mlen = struct.unpack("!I", self.buf[:4])[0]
+                if len(self.buf) >= mlen:
+                    msg, self.buf = self.buf[:mlen], self.buf[mlen:]
+                    return struct.unpack("!I", msg[4:8])[0], msg[8:]
+            left = end - time.time()
+            if left <= 0 or not select.select([self.s], [], [], left)[0]:
+                return None
+            data = self.s.recv(1 << 16)
+            if not data:
+                return None
+            self.buf += data
+
+    def recv_frame(self, timeout):
+        """Next frame the router sent, answering its ARP requests on the way."""
+        while True:
+            msg = self.recv(timeout)
+            if msg is None:
+                return None
+            mtype, body = msg
+            if mtype != VNS_PACKET:
+                continue
+            iface, frame = body[:16].rstrip(b"\0").decode(), body[16:]
+            if (frame[12:14] == b"\x08\x06" and frame[20:22] == b"\x00\x01"
+                    and frame[38:42] == ip("172.64.3.10")):
+                self.send(vns_packet("eth2", arp_reply()))
+                continue
+            return iface, frame
+
+
+def connect(sr_opts):
+    """Starts sr and brings its session up; returns (process, server, log)."""
+    ls = socket.socket()
+    ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    ls.bind(("127.0.0.1", 0))
+    ls.listen(1)
+    ls.settimeout(10)
+    port = ls.getsockname()[1]
+
+    log = tempfile.TemporaryFile()
+    sr = subprocess.Popen(["./sr", "-p", str(port), "-s", "127.0.0.1"] + sr_opts,
+                          stdout=log, stderr=subprocess.STDOUT)
+    sock, _ = ls.accept()
+    ls.close()
+    srv = Server(sock)
+
+    srv.send(vns_msg(VNS_AUTH_REQUEST, b"benchsalt"))
+    if srv.recv(5) is None:
+        raise RuntimeError("sr did not answer the auth request")
+    srv.send(vns_msg(VNS_AUTH_STATUS, b"\x01ok"))
+    hw = b""
+    for name, mac, addr in IFACES:
+        hw += struct.pack("!I", 1) + name.encode().ljust(32, b"\0")
+        hw += struct.pack("!I", 32) + mac.ljust(32, b"\0")
+        hw += struct.pack("!I", 64) + ip(addr).ljust(32, b"\0")
+    srv.send(vns_msg(VNS_HWINFO, hw))
+    return sr, srv, log
+
+
+def run(frames, window, sr_opts):
+    """Runs sr once; returns (pps, syscalls per frame, transport used)."""
+    sr, srv, log = connect(sr_opts)
+    try:
+        # -- one frame through first, so the next hop is resolved --
+        frame = udp_frame()
+        srv.send(vns_packet("eth3", frame))
+        got = srv.recv_frame(5)
+        while got is not None and got[0] != "eth2":
+            got = srv.recv_frame(5)
+        if got is None:
+            raise RuntimeError("sr did not forward the first frame")
+
+        blob = vns_packet("eth3", frame) * BURST
+        bursts = frames // BURST
+        state = {"out": 0, "stop": False}
+
+        def feed():
+            for i in range(bursts):
+                while i * BURST - state["out"] > window:
+                    if state["stop"]:
+                        return
+                    time.sleep(0.0002)
+                srv.send(blob)
+
+        start = time.time()
+        feeder = threading.Thread(target=feed)
+        feeder.start()
+        while state["out"] < bursts * BURST:
+            got = srv.recv_frame(5)
+            if got is None:
+                break
+            if got[0] == "eth2":
+                state["out"] += 1
+        elapsed = time.time() - start
+        state["stop"] = True
+        feeder.join()
+
+        srv.send(vns_msg(VNS_CLOSE, b"benchmark done".ljust(256, b"\0")))
+        sr.wait(10)
+    finally:
+        if sr.poll() is None:
+            sr.kill()
+            sr.wait()
+
+    log.seek(0)
+    out = log.read().decode(errors="replace")
+    m = re.search(r"VNS syscalls \((\w+)\):\n\s+\d+, ([\d.]+) per frame", out)
+    if not m:
+        raise RuntimeError("no syscall count in sr's output:\n" + out[-2000:])
+    return state["out"] / elapsed, float(m.group(2)), m.group(1)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[2].strip())
+    ap.add_argument("--frames", type=int, default=100000)
+    ap.add_argument("--window", type=int, default=1024,
+                    help="frames in flight at most")
+    ap.add_argument("--runs", type=int, default=3)
+    ap.add_argument("sr_opts", nargs="*", help="further options for sr")
+    args = ap.parse_args()
+
+    print("%d frames of 60 bytes, window %d, median of %d runs"
+          % (args.frames // BURST * BURST, args.window, args.runs))
+    print("%-10s %12s %18s" % ("transport", "pps", "syscalls/frame"))
+    for name, opts in (("epoll", []), ("io_uring", ["-U"])):
+        results = sorted(run(args.frames, args.window, opts + args.sr_opts)
+                         for _ in range(args.runs))
+        pps, per_frame, used = results[len(results) // 2]
+        note = "" if used == name else "  (fell back to %s)" % used
+        print("%-10s %12.0f %18.4f%s" % (name, pps, per_frame, note))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())